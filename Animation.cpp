@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <cmath>
+#include "Animation.hpp"
+#include "glm/gtx/transform.hpp"
+using namespace std;
+
+//Convert aiMatrix4x4 to glm::mat4
+void aiMatToGLM4(aiMatrix4x4 &a, glm::mat4 &m) {
+	for(int i = 0; i < 4; i++) {
+		for(int j = 0; j < 4; j++) {
+			m[j][i] = a[i][j];
+		}
+	}
+}
+
+// Add node and its children to the flat list
+static void flattenNode(aiNode *node, int parent, FlatScene &fs) {
+	SceneNode sn;
+	sn.name = node->mName.C_Str();
+	sn.parent = parent;
+	aiMatToGLM4(node->mTransformation, sn.restMat);
+	sn.localMat = sn.restMat;
+	sn.meshes.assign(node->mMeshes, node->mMeshes + node->mNumMeshes);
+
+	int index = (int)fs.nodes.size();
+	fs.nodes.push_back(sn);
+	fs.nodeByName[sn.name] = index;
+
+	for(unsigned int i = 0; i < node->mNumChildren; i++) {
+		flattenNode(node->mChildren[i], index, fs);
+	}
+}
+
+// Flatten the Assimp node tree (parents before children)
+void flattenScene(aiNode *root, FlatScene &fs) {
+	fs.nodes.clear();
+	fs.nodeByName.clear();
+	flattenNode(root, -1, fs);
+	updateGlobalTransforms(fs);
+}
+
+// Recompute global transforms from local transforms
+void updateGlobalTransforms(FlatScene &fs) {
+	for(SceneNode &node : fs.nodes) {
+		if(node.parent < 0) {
+			node.globalMat = node.localMat;
+		}
+		else {
+			node.globalMat = fs.nodes[node.parent].globalMat * node.localMat;
+		}
+	}
+}
+
+// Copy all animations in the scene into clips bound to flattened nodes
+void loadAnimations(const aiScene *scene, FlatScene &fs, vector<AnimationClip> &clips) {
+	clips.clear();
+	for(unsigned int a = 0; a < scene->mNumAnimations; a++) {
+		aiAnimation *anim = scene->mAnimations[a];
+		AnimationClip clip;
+		clip.name = anim->mName.C_Str();
+		clip.duration = anim->mDuration;
+		if(anim->mTicksPerSecond > 0.0) clip.ticksPerSecond = anim->mTicksPerSecond;
+
+		for(unsigned int c = 0; c < anim->mNumChannels; c++) {
+			aiNodeAnim *na = anim->mChannels[c];
+			auto found = fs.nodeByName.find(na->mNodeName.C_Str());
+			if(found == fs.nodeByName.end()) continue;
+
+			AnimChannel ch;
+			ch.node = found->second;
+			for(unsigned int k = 0; k < na->mNumPositionKeys; k++) {
+				aiVectorKey &key = na->mPositionKeys[k];
+				ch.posTimes.push_back(key.mTime);
+				ch.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for(unsigned int k = 0; k < na->mNumRotationKeys; k++) {
+				aiQuatKey &key = na->mRotationKeys[k];
+				ch.rotTimes.push_back(key.mTime);
+				ch.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for(unsigned int k = 0; k < na->mNumScalingKeys; k++) {
+				aiVectorKey &key = na->mScalingKeys[k];
+				ch.scaleTimes.push_back(key.mTime);
+				ch.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			clip.channels.push_back(ch);
+		}
+		clips.push_back(clip);
+	}
+}
+
+// Copy the bones of every scene mesh
+void loadMeshSkins(const aiScene *scene, FlatScene &fs, vector<MeshSkin> &skins) {
+	skins.assign(scene->mNumMeshes, MeshSkin());
+	for(unsigned int m = 0; m < scene->mNumMeshes; m++) {
+		aiMesh *mesh = scene->mMeshes[m];
+		for(unsigned int b = 0; b < mesh->mNumBones; b++) {
+			aiBone *bone = mesh->mBones[b];
+			SkinBone sb;
+			auto found = fs.nodeByName.find(bone->mName.C_Str());
+			if(found != fs.nodeByName.end()) sb.node = found->second;
+			aiMatToGLM4(bone->mOffsetMatrix, sb.offsetMat);
+			skins[m].bones.push_back(sb);
+		}
+	}
+}
+
+// Find key pair around time t; returns index of first key and blend factor
+static int findKey(const vector<double> &times, double t, float &blend) {
+	blend = 0.0f;
+	if(times.size() <= 1 || t <= times.front()) return 0;
+	if(t >= times.back()) return (int)times.size() - 1;
+
+	int next = (int)(upper_bound(times.begin(), times.end(), t) - times.begin());
+	int prev = next - 1;
+	double span = times[next] - times[prev];
+	if(span > 0.0) blend = (float)((t - times[prev]) / span);
+	return prev;
+}
+
+// Interpolate vector keys
+static glm::vec3 sampleVec3(const vector<double> &times, const vector<glm::vec3> &values, double t) {
+	float blend;
+	int k = findKey(times, t, blend);
+	if(blend == 0.0f) return values[k];
+	return glm::mix(values[k], values[k + 1], blend);
+}
+
+// Interpolate rotation keys
+static glm::quat sampleQuat(const vector<double> &times, const vector<glm::quat> &values, double t) {
+	float blend;
+	int k = findKey(times, t, blend);
+	if(blend == 0.0f) return values[k];
+	return glm::normalize(glm::slerp(values[k], values[k + 1], blend));
+}
+
+// Sample a clip at a time (seconds, looping) into the local transforms of its nodes
+void sampleAnimation(const AnimationClip &clip, double seconds, FlatScene &fs) {
+	double ticks = seconds * clip.ticksPerSecond;
+	if(clip.duration > 0.0) ticks = fmod(ticks, clip.duration);
+
+	for(const AnimChannel &ch : clip.channels) {
+		SceneNode &node = fs.nodes[ch.node];
+
+		// Channels without keys of a kind keep the rest value of that kind
+		// (rest scale = column lengths of the upper 3x3, rest rotation = the columns divided by them)
+		glm::vec3 restPos = glm::vec3(node.restMat[3]);
+		glm::vec3 restScale;
+		for(int c = 0; c < 3; c++) restScale[c] = glm::length(glm::vec3(node.restMat[c]));
+		glm::vec3 pos = ch.positions.empty() ? restPos : sampleVec3(ch.posTimes, ch.positions, ticks);
+		glm::vec3 scale = ch.scales.empty() ? restScale : sampleVec3(ch.scaleTimes, ch.scales, ticks);
+
+		glm::mat4 rot;
+		if(ch.rotations.empty()) {
+			glm::mat3 restRot = glm::mat3(node.restMat);
+			for(int c = 0; c < 3; c++) {
+				if(restScale[c] > 0.0f) restRot[c] /= restScale[c];
+			}
+			rot = glm::mat4(restRot);
+		}
+		else {
+			rot = glm::mat4_cast(sampleQuat(ch.rotTimes, ch.rotations, ticks));
+		}
+
+		node.localMat = glm::translate(pos) * rot * glm::scale(scale);
+	}
+}
+
+// Restore rest transforms (used when switching clips)
+void resetToRestPose(FlatScene &fs) {
+	for(SceneNode &node : fs.nodes) {
+		node.localMat = node.restMat;
+	}
+}
+
+// Advance clock by real elapsed time; returns number of fixed steps taken
+int advanceClock(FixedClock &clock, double elapsed) {
+	if(clock.paused) return 0;
+
+	clock.accumulator += elapsed;
+	int steps = 0;
+	while(clock.accumulator >= clock.step && steps < clock.maxSteps) {
+		clock.time += clock.step;
+		clock.accumulator -= clock.step;
+		steps++;
+	}
+
+	// Drop time we could not catch up on
+	if(steps == clock.maxSteps) clock.accumulator = 0.0;
+	return steps;
+}
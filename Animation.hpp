@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <assimp/scene.h>
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+// Struct for holding one node of the flattened scene graph
+struct SceneNode {
+	std::string name;
+	// Index of parent node (-1 for root); parents always come before children
+	int parent = -1;
+	// Transform from file and current (possibly animated) local transform
+	glm::mat4 restMat;
+	glm::mat4 localMat;
+	// Local transform times all parent transforms
+	glm::mat4 globalMat;
+	// Scene mesh indices drawn at this node
+	std::vector<unsigned int> meshes;
+};
+
+// Struct for holding the flattened scene graph
+struct FlatScene {
+	std::vector<SceneNode> nodes;
+	std::unordered_map<std::string, int> nodeByName;
+};
+
+// Keyframes for one animated node
+struct AnimChannel {
+	int node = -1;
+	std::vector<double> posTimes, rotTimes, scaleTimes;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+};
+
+// Struct for holding one animation clip (times are in ticks)
+struct AnimationClip {
+	std::string name;
+	double duration = 0.0;
+	double ticksPerSecond = 25.0;
+	std::vector<AnimChannel> channels;
+};
+
+// Bone of a skinned mesh: node driving it and mesh-to-bone (inverse bind) matrix
+struct SkinBone {
+	int node = -1;
+	glm::mat4 offsetMat;
+};
+
+// Bones of one scene mesh (vertex bone IDs index into this list)
+struct MeshSkin {
+	std::vector<SkinBone> bones;
+};
+
+// Clock that advances animation time in fixed steps
+struct FixedClock {
+	double step = 1.0 / 60.0;
+	double accumulator = 0.0;
+	double time = 0.0;
+	// Avoid spiraling after a long stall
+	int maxSteps = 8;
+	bool paused = false;
+};
+
+// Convert aiMatrix4x4 to glm::mat4
+void aiMatToGLM4(aiMatrix4x4 &a, glm::mat4 &m);
+
+// Flatten the Assimp node tree (parents before children)
+void flattenScene(aiNode *root, FlatScene &fs);
+
+// Recompute global transforms from local transforms
+void updateGlobalTransforms(FlatScene &fs);
+
+// Copy all animations in the scene into clips bound to flattened nodes
+void loadAnimations(const aiScene *scene, FlatScene &fs, std::vector<AnimationClip> &clips);
+
+// Copy the bones of every scene mesh
+void loadMeshSkins(const aiScene *scene, FlatScene &fs, std::vector<MeshSkin> &skins);
+
+// Sample a clip at a time (seconds, looping) into the local transforms of its nodes
+void sampleAnimation(const AnimationClip &clip, double seconds, FlatScene &fs);
+
+// Restore rest transforms (used when switching clips)
+void resetToRestPose(FlatScene &fs);
+
+// Advance clock by real elapsed time; returns number of fixed steps taken
+int advanceClock(FixedClock &clock, double elapsed);
@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "BVH.hpp"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BVH_USE_SSE
+#endif
+using namespace std;
+
+// Binned SAH settings
+const int BIN_CNT = 16;
+const int MAX_LEAF_SIZE = 8;
+const float TRAVERSAL_COST = 1.0f;
+const float INTERSECT_COST = 1.5f;
+
+// Traversal stack size; the builder keeps every leaf at depth STACK_SIZE - 1 or less, so the stack cannot overflow
+const int STACK_SIZE = 64;
+
+// Bounds and centroid of one primitive during the build
+struct BuildPrim {
+	glm::vec3 bmin;
+	glm::vec3 bmax;
+	glm::vec3 centroid;
+};
+
+// One SAH bin
+struct BuildBin {
+	glm::vec3 bmin = glm::vec3(FLT_MAX);
+	glm::vec3 bmax = glm::vec3(-FLT_MAX);
+	int count = 0;
+};
+
+// Surface area of a box (0 if empty)
+static float surfaceArea(glm::vec3 bmin, glm::vec3 bmax) {
+	glm::vec3 e = bmax - bmin;
+	if(e.x < 0.0f || e.y < 0.0f || e.z < 0.0f) return 0.0f;
+	return 2.0f * (e.x*e.y + e.y*e.z + e.z*e.x);
+}
+
+// SAH bin of a centroid coordinate (clamped: scale can overflow for tiny extents)
+static inline int binIndex(float value, float minValue, float scale) {
+	float b = (value - minValue) * scale;
+	if(!(b > 0.0f)) return 0;
+	return min(BIN_CNT - 1, (int)min(b, (float)(BIN_CNT - 1)));
+}
+
+// Build BVH over primitives; order receives the primitive permutation (leaf order)
+static void buildBVH(vector<BuildPrim> &prims, vector<int> &order, vector<BVHNode> &nodes) {
+	int primCnt = (int)prims.size();
+	order.resize(primCnt);
+	for(int i = 0; i < primCnt; i++) order[i] = i;
+
+	nodes.clear();
+	nodes.reserve(max(1, 2 * primCnt));
+	BVHNode root;
+	root.leftOrFirst = 0;
+	root.count = primCnt;
+	nodes.push_back(root);
+
+	// Node index and depth
+	vector<pair<int, int>> stack;
+	stack.push_back(make_pair(0, 0));
+	while(!stack.empty()) {
+		int nodeIndex = stack.back().first;
+		int depth = stack.back().second;
+		stack.pop_back();
+		int first = nodes[nodeIndex].leftOrFirst;
+		int count = nodes[nodeIndex].count;
+
+		// Bounds of primitives and of their centroids
+		glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+		glm::vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+		for(int i = first; i < first + count; i++) {
+			BuildPrim &p = prims[order[i]];
+			bmin = glm::min(bmin, p.bmin);
+			bmax = glm::max(bmax, p.bmax);
+			cmin = glm::min(cmin, p.centroid);
+			cmax = glm::max(cmax, p.centroid);
+		}
+		BVHNode &node = nodes[nodeIndex];
+		for(int a = 0; a < 3; a++) {
+			node.bmin[a] = (count > 0) ? bmin[a] : 0.0f;
+			node.bmax[a] = (count > 0) ? bmax[a] : 0.0f;
+		}
+		// Too deep for the traversal stack: stay a leaf even if it is larger than MAX_LEAF_SIZE
+		if(count <= 2 || depth >= STACK_SIZE - 1) continue;
+
+		// Find the cheapest binned split over all three axes
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestSplit = 0;
+		for(int axis = 0; axis < 3; axis++) {
+			float extent = cmax[axis] - cmin[axis];
+			if(extent <= 0.0f) continue;
+			float scale = BIN_CNT / extent;
+
+			BuildBin bins[BIN_CNT];
+			for(int i = first; i < first + count; i++) {
+				BuildPrim &p = prims[order[i]];
+				int b = binIndex(p.centroid[axis], cmin[axis], scale);
+				bins[b].count++;
+				bins[b].bmin = glm::min(bins[b].bmin, p.bmin);
+				bins[b].bmax = glm::max(bins[b].bmax, p.bmax);
+			}
+
+			// Sweep from both sides
+			float leftArea[BIN_CNT - 1], rightArea[BIN_CNT - 1];
+			int leftCnt[BIN_CNT - 1], rightCnt[BIN_CNT - 1];
+			glm::vec3 lmin(FLT_MAX), lmax(-FLT_MAX), rmin(FLT_MAX), rmax(-FLT_MAX);
+			int lsum = 0, rsum = 0;
+			for(int i = 0; i < BIN_CNT - 1; i++) {
+				lsum += bins[i].count;
+				lmin = glm::min(lmin, bins[i].bmin);
+				lmax = glm::max(lmax, bins[i].bmax);
+				leftCnt[i] = lsum;
+				leftArea[i] = surfaceArea(lmin, lmax);
+
+				int j = BIN_CNT - 1 - i;
+				rsum += bins[j].count;
+				rmin = glm::min(rmin, bins[j].bmin);
+				rmax = glm::max(rmax, bins[j].bmax);
+				rightCnt[j - 1] = rsum;
+				rightArea[j - 1] = surfaceArea(rmin, rmax);
+			}
+
+			for(int i = 0; i < BIN_CNT - 1; i++) {
+				if(leftCnt[i] == 0 || rightCnt[i] == 0) continue;
+				float cost = leftArea[i] * leftCnt[i] + rightArea[i] * rightCnt[i];
+				if(cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+		if(bestAxis < 0) continue;
+
+		// Stay a leaf if splitting does not pay off (unless the leaf would be large)
+		float area = surfaceArea(bmin, bmax);
+		float splitCost = TRAVERSAL_COST + INTERSECT_COST * bestCost / max(area, FLT_MIN);
+		float leafCost = INTERSECT_COST * count;
+		if(splitCost >= leafCost && count <= MAX_LEAF_SIZE) continue;
+
+		// Partition primitives around the split
+		float splitMin = cmin[bestAxis];
+		float splitScale = BIN_CNT / (cmax[bestAxis] - cmin[bestAxis]);
+		int *mid = partition(order.data() + first, order.data() + first + count, [&](int index) {
+			return binIndex(prims[index].centroid[bestAxis], splitMin, splitScale) <= bestSplit;
+		});
+		int leftCount = (int)(mid - (order.data() + first));
+		if(leftCount == 0 || leftCount == count) continue;
+
+		// Children are allocated as an adjacent pair
+		int leftIndex = (int)nodes.size();
+		BVHNode left, right;
+		left.leftOrFirst = first;
+		left.count = leftCount;
+		right.leftOrFirst = first + leftCount;
+		right.count = count - leftCount;
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		nodes[nodeIndex].leftOrFirst = leftIndex;
+		nodes[nodeIndex].count = 0;
+		stack.push_back(make_pair(leftIndex + 1, depth + 1));
+		stack.push_back(make_pair(leftIndex, depth + 1));
+	}
+	nodes.shrink_to_fit();
+}
+
+// Build triangle BVH with binned SAH
+void buildMeshBVH(const Mesh &m, MeshBVH &bvh) {
+	int triCnt = (int)(m.indices.size() / 3);
+	vector<BuildPrim> prims(triCnt);
+	for(int t = 0; t < triCnt; t++) {
+		glm::vec3 a = m.vertices[m.indices[3*t]].position;
+		glm::vec3 b = m.vertices[m.indices[3*t + 1]].position;
+		glm::vec3 c = m.vertices[m.indices[3*t + 2]].position;
+		prims[t].bmin = glm::min(a, glm::min(b, c));
+		prims[t].bmax = glm::max(a, glm::max(b, c));
+		prims[t].centroid = (a + b + c) / 3.0f;
+	}
+
+	vector<int> order;
+	buildBVH(prims, order, bvh.nodes);
+
+	// Store triangles in leaf order
+	bvh.triangles.resize(triCnt);
+	for(int i = 0; i < triCnt; i++) {
+		int t = order[i];
+		glm::vec3 a = m.vertices[m.indices[3*t]].position;
+		glm::vec3 b = m.vertices[m.indices[3*t + 1]].position;
+		glm::vec3 c = m.vertices[m.indices[3*t + 2]].position;
+		bvh.triangles[i].v0 = a;
+		bvh.triangles[i].e1 = b - a;
+		bvh.triangles[i].e2 = c - a;
+		bvh.triangles[i].triIndex = t;
+	}
+}
+
+// Build top-level BVH over instances (their world bounds come from the mesh BVH roots)
+void buildSceneBVH(vector<PickInstance> &instances, vector<MeshBVH> &meshBVHs, SceneBVH &sbvh) {
+	vector<BuildPrim> prims(instances.size());
+	for(unsigned int i = 0; i < instances.size(); i++) {
+		PickInstance &inst = instances[i];
+		inst.invModelMat = glm::inverse(inst.modelMat);
+
+		// Transform the eight corners of the mesh bounds
+		BuildPrim &p = prims[i];
+		p.bmin = glm::vec3(FLT_MAX);
+		p.bmax = glm::vec3(-FLT_MAX);
+		MeshBVH &mb = meshBVHs.at(inst.meshBVH);
+		if(!mb.nodes.empty() && !mb.triangles.empty()) {
+			BVHNode &root = mb.nodes[0];
+			for(int c = 0; c < 8; c++) {
+				glm::vec4 corner((c & 1) ? root.bmax[0] : root.bmin[0],
+					(c & 2) ? root.bmax[1] : root.bmin[1],
+					(c & 4) ? root.bmax[2] : root.bmin[2], 1.0f);
+				glm::vec3 world = glm::vec3(inst.modelMat * corner);
+				p.bmin = glm::min(p.bmin, world);
+				p.bmax = glm::max(p.bmax, world);
+			}
+		}
+		else {
+			// Empty mesh: degenerate box far away from everything
+			p.bmin = p.bmax = glm::vec3(FLT_MAX);
+		}
+		p.centroid = 0.5f * (p.bmin + p.bmax);
+	}
+
+	vector<int> order;
+	buildBVH(prims, order, sbvh.nodes);
+	sbvh.instances.resize(instances.size());
+	for(unsigned int i = 0; i < order.size(); i++) {
+		sbvh.instances[i] = instances[order[i]];
+	}
+}
+
+// Ray with precomputed reciprocal direction
+struct TraceRay {
+	glm::vec3 origin;
+	glm::vec3 dir;
+	glm::vec3 invDir;
+#ifdef BVH_USE_SSE
+	__m128 origin4;
+	__m128 invDir4;
+#endif
+};
+
+// Set up ray for box tests
+static void setupTraceRay(TraceRay &ray, glm::vec3 origin, glm::vec3 dir) {
+	ray.origin = origin;
+	ray.dir = dir;
+	ray.invDir = glm::vec3(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+#ifdef BVH_USE_SSE
+	ray.origin4 = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+	ray.invDir4 = _mm_set_ps(0.0f, ray.invDir.z, ray.invDir.y, ray.invDir.x);
+#endif
+}
+
+// Slab test; returns entry distance or FLT_MAX on a miss (or if beyond maxT)
+static inline float intersectBox(const BVHNode &node, const TraceRay &ray, float maxT) {
+#ifdef BVH_USE_SSE
+	// bmin/bmax are followed by an int, so only lanes 0-2 are used below
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmin), ray.origin4), ray.invDir4);
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bmax), ray.origin4), ray.invDir4);
+	__m128 vmin = _mm_min_ps(t1, t2);
+	__m128 vmax = _mm_max_ps(t1, t2);
+	__m128 nearT = _mm_max_ss(_mm_max_ss(vmin, _mm_shuffle_ps(vmin, vmin, _MM_SHUFFLE(1, 1, 1, 1))),
+		_mm_shuffle_ps(vmin, vmin, _MM_SHUFFLE(2, 2, 2, 2)));
+	__m128 farT = _mm_min_ss(_mm_min_ss(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(1, 1, 1, 1))),
+		_mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(2, 2, 2, 2)));
+	float tnear = _mm_cvtss_f32(nearT);
+	float tfar = _mm_cvtss_f32(farT);
+#else
+	float tnear = -FLT_MAX, tfar = FLT_MAX;
+	for(int a = 0; a < 3; a++) {
+		float t1 = (node.bmin[a] - ray.origin[a]) * ray.invDir[a];
+		float t2 = (node.bmax[a] - ray.origin[a]) * ray.invDir[a];
+		tnear = max(tnear, min(t1, t2));
+		tfar = min(tfar, max(t1, t2));
+	}
+#endif
+	if(tfar >= tnear && tfar >= 0.0f && tnear < maxT) return tnear;
+	return FLT_MAX;
+}
+
+// Moller-Trumbore triangle test; updates bestT if closer
+static inline bool intersectTriangle(const BVHTriangle &tri, const TraceRay &ray, float &bestT) {
+	glm::vec3 p = glm::cross(ray.dir, tri.e2);
+	float det = glm::dot(tri.e1, p);
+	if(fabs(det) < 1e-12f) return false;
+	float invDet = 1.0f / det;
+
+	glm::vec3 tv = ray.origin - tri.v0;
+	float u = glm::dot(tv, p) * invDet;
+	if(u < 0.0f || u > 1.0f) return false;
+
+	glm::vec3 q = glm::cross(tv, tri.e1);
+	float v = glm::dot(ray.dir, q) * invDet;
+	if(v < 0.0f || u + v > 1.0f) return false;
+
+	float t = glm::dot(tri.e2, q) * invDet;
+	if(t <= 1e-6f || t >= bestT) return false;
+	bestT = t;
+	return true;
+}
+
+// Closest triangle hit in one mesh BVH; returns triangle index or -1
+static int traceMesh(const MeshBVH &bvh, const TraceRay &ray, float &bestT) {
+	if(bvh.nodes.empty() || bvh.triangles.empty()) return -1;
+	if(intersectBox(bvh.nodes[0], ray, bestT) == FLT_MAX) return -1;
+
+	int hitTri = -1;
+	int stack[STACK_SIZE];
+	float stackT[STACK_SIZE];
+	int sp = 0;
+	int index = 0;
+	while(true) {
+		const BVHNode &node = bvh.nodes[index];
+		if(node.count > 0) {
+			for(int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+				if(intersectTriangle(bvh.triangles[i], ray, bestT)) hitTri = bvh.triangles[i].triIndex;
+			}
+		}
+		else {
+			// Visit nearer child first; push the other
+			int nearChild = node.leftOrFirst;
+			int farChild = node.leftOrFirst + 1;
+			float tNear = intersectBox(bvh.nodes[nearChild], ray, bestT);
+			float tFar = intersectBox(bvh.nodes[farChild], ray, bestT);
+			if(tNear > tFar) {
+				swap(tNear, tFar);
+				swap(nearChild, farChild);
+			}
+			if(tNear != FLT_MAX) {
+				// At most one entry per level above the current node
+				if(tFar != FLT_MAX) {
+					stack[sp] = farChild;
+					stackT[sp] = tFar;
+					sp++;
+				}
+				index = nearChild;
+				continue;
+			}
+		}
+
+		// Pop next node that can still beat the best hit
+		bool found = false;
+		while(sp > 0) {
+			sp--;
+			if(stackT[sp] < bestT) {
+				index = stack[sp];
+				found = true;
+				break;
+			}
+		}
+		if(!found) break;
+	}
+	return hitTri;
+}
+
+// Closest hit along a ray (direction does not need to be normalized)
+PickHit pickScene(SceneBVH &sbvh, vector<MeshBVH> &meshBVHs, glm::vec3 origin, glm::vec3 dir) {
+	PickHit result;
+	if(sbvh.nodes.empty() || sbvh.instances.empty()) return result;
+
+	TraceRay ray;
+	setupTraceRay(ray, origin, dir);
+	float bestT = FLT_MAX;
+	if(intersectBox(sbvh.nodes[0], ray, bestT) == FLT_MAX) return result;
+
+	int stack[STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+	while(sp > 0) {
+		const BVHNode &node = sbvh.nodes[stack[--sp]];
+		if(intersectBox(node, ray, bestT) == FLT_MAX) continue;
+
+		// Holds at most depth + 2 entries after the push
+		if(node.count == 0) {
+			stack[sp++] = node.leftOrFirst + 1;
+			stack[sp++] = node.leftOrFirst;
+			continue;
+		}
+
+		// Trace each instance in its mesh space (t is the same since dir is not renormalized)
+		for(int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+			PickInstance &inst = sbvh.instances[i];
+			TraceRay local;
+			setupTraceRay(local, glm::vec3(inst.invModelMat * glm::vec4(origin, 1.0f)),
+				glm::mat3(inst.invModelMat) * dir);
+			int tri = traceMesh(meshBVHs[inst.meshBVH], local, bestT);
+			if(tri >= 0) {
+				result.hit = true;
+				result.node = inst.node;
+				result.sceneMesh = inst.sceneMesh;
+				result.triangle = tri;
+			}
+		}
+	}
+
+	if(result.hit) {
+		result.position = origin + bestT * dir;
+		result.distance = bestT * glm::length(dir);
+	}
+	return result;
+}
+
+// Size of a BVH in bytes
+size_t meshBVHBytes(const MeshBVH &bvh) {
+	return bvh.nodes.size() * sizeof(BVHNode) + bvh.triangles.size() * sizeof(BVHTriangle);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "Mesh.hpp"
+
+// Flattened BVH node (32 bytes, two per cache line)
+// Interior: children are nodes leftOrFirst and leftOrFirst+1 (count == 0)
+// Leaf: primitives leftOrFirst .. leftOrFirst+count-1
+struct BVHNode {
+	float bmin[3];
+	int leftOrFirst;
+	float bmax[3];
+	int count;
+};
+
+// Triangle stored in leaf order (no index lookups while tracing)
+struct BVHTriangle {
+	glm::vec3 v0;
+	glm::vec3 e1;
+	glm::vec3 e2;
+	// Index of the triangle in the original mesh
+	int triIndex;
+};
+
+// Struct for holding the triangle BVH of one mesh (in mesh space)
+struct MeshBVH {
+	std::vector<BVHNode> nodes;
+	std::vector<BVHTriangle> triangles;
+};
+
+// One placed copy of a mesh, as seen by picking
+struct PickInstance {
+	// Flattened scene node and Assimp mesh it came from
+	int node = -1;
+	int sceneMesh = -1;
+	// Which MeshBVH to trace
+	int meshBVH = -1;
+	glm::mat4 modelMat;
+	glm::mat4 invModelMat;
+};
+
+// Struct for holding the top-level BVH over all instances
+struct SceneBVH {
+	std::vector<BVHNode> nodes;
+	std::vector<PickInstance> instances;
+};
+
+// Result of a pick query
+struct PickHit {
+	bool hit = false;
+	int node = -1;
+	int sceneMesh = -1;
+	int triangle = -1;
+	float distance = 0.0f;
+	glm::vec3 position;
+};
+
+// Build triangle BVH with binned SAH
+void buildMeshBVH(const Mesh &m, MeshBVH &bvh);
+
+// Build top-level BVH over instances (their world bounds come from the mesh BVH roots)
+void buildSceneBVH(std::vector<PickInstance> &instances, std::vector<MeshBVH> &meshBVHs, SceneBVH &sbvh);
+
+// Closest hit along a ray (direction does not need to be normalized)
+PickHit pickScene(SceneBVH &sbvh, std::vector<MeshBVH> &meshBVHs, glm::vec3 origin, glm::vec3 dir);
+
+// Size of a BVH in bytes
+size_t meshBVHBytes(const MeshBVH &bvh);
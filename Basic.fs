@@ -1,20 +1,72 @@
 #version 430 core
 
+// Variant defines are inserted after the #version line by the program:
+// TEXTURED, UNLIT, DIELECTRIC, METAL, USE_BRDF_LUT,
+// FIXED_MATERIAL (with FIXED_METALLIC and FIXED_ROUGHNESS),
+// DEBUG_NORMALS, DEBUG_ALBEDO, DEBUG_SPECULAR
+
 layout(location=0) out vec4 out_color;
- 
+
 in vec4 vertexColor; // Now interpolated across face
 in vec4 interPos;
 in vec3 interNormal;
+in vec2 interUV;
+in vec3 interWorldPos;
+flat in vec4 interLightPos; // Light position in view space (per view)
 
-//Structure to hold Point Light
+//Structure to hold Point Light (only the color is used; the position comes from the view)
 struct PointLight {
 vec4 pos;
 vec4 color;
 };
 
 uniform PointLight light;
-uniform float metallic;
+
+//Material: constants where the variant allows it, so the compiler can fold them away
+#if defined(FIXED_MATERIAL)
+const float metallic = FIXED_METALLIC;
+const float roughness = FIXED_ROUGHNESS;
+#else
 uniform float roughness;
+#if defined(DIELECTRIC)
+const float metallic = 0.0;
+#elif defined(METAL)
+const float metallic = 1.0;
+#else
+uniform float metallic;
+#endif
+#endif
+
+#ifdef TEXTURED
+//Diffuse texture
+uniform sampler2D diffuseTex;
+#endif
+
+#ifdef USE_BRDF_LUT
+//x = cosine, y = roughness; r = Schlick geometry term (only the terms that depend on roughness are worth a fetch)
+uniform sampler2D brdfLut;
+
+float sampleBRDFLut(float cosAngle, float rough) {
+	float size = float(textureSize(brdfLut, 0).x);
+	vec2 coord = (vec2(cosAngle, rough) * (size - 1.0) + 0.5) / size;
+	return texture(brdfLut, coord).r;
+}
+#endif
+
+//Omnidirectional shadow of the point light: distance to the light / shadowFar,
+//split into cached casters (static) and moving casters (dynamic)
+uniform samplerCube shadowStatic;
+uniform samplerCube shadowDynamic;
+uniform vec3 shadowLightPos;
+uniform float shadowFar;
+
+float getShadow(vec3 worldPos) {
+	vec3 toFrag = worldPos - shadowLightPos;
+	float dist = length(toFrag);
+	float closest = min(texture(shadowStatic, toFrag).r, texture(shadowDynamic, toFrag).r) * shadowFar;
+	float bias = 0.005 + 0.01 * dist;
+	return (dist - bias > closest) ? 0.0 : 1.0;
+}
 
 const float pi = 3.14159265359;
 
@@ -25,22 +77,33 @@ vec3 getFresnelAtAngleZero(vec3 albedo, float metallic) {
 }
 
 vec3 getFresnel(vec3 F0, vec3 L, vec3 H) {
+	// (1 - cos)^5 does not depend on roughness, so it is always cheaper to compute than to look up
 	float cosAngle = max(0, dot(L, H));
-	F0 = F0 + (1 - F0) * pow((1 - max(0, cosAngle)), 5.0);
+	float m = 1 - cosAngle;
+	float m2 = m * m;
+	float weight = m2 * m2 * m;
+	F0 = F0 + (1 - F0) * weight;
 	return F0;
 }
 
  float getNDF(vec3 H, vec3 N, float roughness) {
-	float NDF;
-	NDF = (pow(roughness, 4.0)) / (pi * pow((pow(dot(N, H), 2.0) * (pow(roughness, 4.0) - 1) + 1), 2.0));
+	float a2 = roughness * roughness;
+	a2 = a2 * a2;
+	float NdotH = dot(N, H);
+	float d = NdotH * NdotH * (a2 - 1) + 1;
+	float NDF = a2 / (pi * d * d);
 	return NDF;
  }
 
  float getSchlickGeo(vec3 B, vec3 N, float roughness) {
+#ifdef USE_BRDF_LUT
+	 return sampleBRDFLut(max(0, dot(N, B)), roughness);
+#else
 	 float k, SG;
-	 k = ((pow(roughness + 1, 2.0)) / 8);
+	 k = ((roughness + 1) * (roughness + 1)) / 8;
 	 SG = (dot(N, B)) / ((dot(N, B)*(1 - k) + k));
 	 return SG;
+#endif
  }
 
 float getGF(vec3 L, vec3 V, vec3 N, float roughness) {
@@ -51,35 +114,41 @@ float getGF(vec3 L, vec3 V, vec3 N, float roughness) {
 	return GF;
 }
 
-void main() {	
+void main() {
 	vec3 N = normalize(interNormal);
-	
-	/*
-	This section is now irrelevant
-	// Just output interpolated color
-	out_color = vertexColor;
-	*/
 
+	// Texture color (white if untextured)
+#ifdef TEXTURED
+	vec3 texColor = texture(diffuseTex, interUV).rgb;
+#else
+	vec3 texColor = vec3(1.0);
+#endif
+	vec3 albedo = vec3(vertexColor) * texColor;
+
+#if defined(DEBUG_NORMALS)
+	out_color = vec4(N * 0.5 + 0.5, 1.0);
+#elif defined(DEBUG_ALBEDO) || defined(UNLIT)
+	out_color = vec4(albedo, 1.0);
+#else
     vec3 V = normalize(-vec3(interPos));
-	vec3 f0 = getFresnelAtAngleZero(vec3(vertexColor), metallic);
-	vec3 L = vec3(light.pos - interPos);
-	float d = length(L);
-  	float at = 1.0 / (d * d + 1.0);
+	vec3 f0 = getFresnelAtAngleZero(albedo, metallic);
+	vec3 L = vec3(interLightPos - interPos);
 
 	L = normalize(L);
 	vec3 H = normalize(L + V);
 	vec3 F = getFresnel(f0, L, H);
 	vec3 kS = F;
-	//Calculate Diffuse Color
 	vec3 kD = 1.0 - kS;
-	vec3 diffColor = (kD * (1.0 - metallic) * vec3(vertexColor)) / pi;
-	float diffuse = max(0, dot(L, N));
-	//Calculate Complete Specular Reflection
+	//Calculate Specular Reflection
 	float NDF = getNDF(H, N, roughness);
 	float G = getGF(L, V, N, roughness);
 	kS = kS * NDF * G;
-	vec3 compSpecRef = kS / ((4.0 * max(0, dot(N , L)) * max(0, dot(N , V))) + 0.0001);
- 	vec3 finalColor = (kD + kS)*vec3(light.color)*max(0, dot(N,L));
-	 
+
+#ifdef DEBUG_SPECULAR
+	out_color = vec4(kS, 1.0);
+#else
+ 	vec3 finalColor = (kD*texColor + kS)*vec3(light.color)*max(0, dot(N,L))*getShadow(interWorldPos);
 	out_color = vec4(finalColor, 1.0);
+#endif
+#endif
 }
@@ -3,32 +3,91 @@
 layout(location=0) in vec3 position;
 layout(location=1) in vec4 color;
 layout(location=2) in vec3 normal;
+layout(location=3) in vec2 texcoord;
+
+// Per-instance transforms (locations 4-7 and 8-10)
+layout(location=4) in mat4 modelMat;
+layout(location=8) in mat3 normMat;
+layout(location=11) in int boneOffset;
+
+// Skinning: up to four bones per vertex
+layout(location=12) in ivec4 boneIDs;
+layout(location=13) in vec4 boneWeights;
+
+// Bone matrices of all skinned instances
+layout(std430, binding=0) readonly buffer BonePalette {
+	mat4 bones[];
+};
+
+// Most views drawn in one pass (MAX_VIEWS in MultiView.hpp)
+#define MAX_VIEWS 8
+
+// Camera of one view
+struct ViewData {
+	mat4 viewMat;
+	mat4 projMat;
+	// Light position in view space
+	vec4 lightPos;
+	// Scale (xy) and offset (zw) from the view's clip space to its part of the target
+	vec4 clipRect;
+};
+
+layout(std140, binding=0) uniform ViewBlock {
+	ViewData views[MAX_VIEWS];
+	int viewCnt;
+};
 
 out vec3 interNormal;
 out vec4 vertexColor;
 out vec4 interPos;
-
-uniform mat3 normMat;
-uniform mat4 modelMat;
-uniform mat4 viewMat;
-uniform mat4 projMat;
+out vec2 interUV;
+out vec3 interWorldPos;
+flat out vec4 interLightPos;
 
 
 void main()
 {
+	// Every instance is drawn once per view (instanced attributes advance every viewCnt instances)
+	int viewIndex = gl_InstanceID % viewCnt;
+	mat4 viewMat = views[viewIndex].viewMat;
+
+	// Blend bone matrices (skinned instances only; vertices without weights keep the bind pose)
+	mat4 skinMat = mat4(1.0);
+	float weightSum = boneWeights.x + boneWeights.y + boneWeights.z + boneWeights.w;
+	if(boneOffset >= 0 && weightSum > 0.0) {
+		skinMat = boneWeights.x * bones[boneOffset + boneIDs.x]
+				+ boneWeights.y * bones[boneOffset + boneIDs.y]
+				+ boneWeights.z * bones[boneOffset + boneIDs.z]
+				+ boneWeights.w * bones[boneOffset + boneIDs.w];
+	}
 
 	// Get position of vertex (object space)
-	vec4 objPos = vec4(position, 1.0);
+	vec4 objPos = skinMat * vec4(position, 1.0);
 
 	// calculate position after model and view transformations
 	interPos = viewMat * modelMat * objPos;
 
-	//calculate normal position after normal transformation
-	interNormal = normMat * normal;
+	// World position (for the shadow lookup)
+	interWorldPos = vec3(modelMat * objPos);
+
+	//calculate normal position after normal transformation (view matrix is rigid)
+	interNormal = mat3(viewMat) * normMat * mat3(skinMat) * normal;
 
-	// For now, just pass along vertex position (no transformations)
-	gl_Position = projMat * viewMat * modelMat * objPos;
+	// Light position in this view
+	interLightPos = views[viewIndex].lightPos;
+
+	// Clip against the edges of the view, then move it into its viewport
+	vec4 clipPos = views[viewIndex].projMat * interPos;
+	gl_ClipDistance[0] = clipPos.w + clipPos.x;
+	gl_ClipDistance[1] = clipPos.w - clipPos.x;
+	gl_ClipDistance[2] = clipPos.w + clipPos.y;
+	gl_ClipDistance[3] = clipPos.w - clipPos.y;
+	vec4 clipRect = views[viewIndex].clipRect;
+	gl_Position = vec4(clipPos.xy * clipRect.xy + clipRect.zw * clipPos.w, clipPos.zw);
 
 	// Output per-vertex color
 	vertexColor = color;
+
+	// Pass along texture coordinates
+	interUV = texcoord;
 }
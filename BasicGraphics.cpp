@@ -1,8 +1,9 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <thread>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <GL/glew.h>					
 #include <GLFW/glfw3.h>
 #include <assimp/Importer.hpp>
@@ -14,6 +15,16 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include "glm/gtx/string_cast.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include "Texture.hpp"
+#include "Mesh.hpp"
+#include "Animation.hpp"
+#include "RenderTarget.hpp"
+#include "Shader.hpp"
+#include "BVH.hpp"
+#include "SoftRaster.hpp"
+#include "Shadow.hpp"
+#include "Transform.hpp"
+#include "MultiView.hpp"
 using namespace std;
 
 // Global Variable for rotation Angle
@@ -25,6 +36,9 @@ glm::vec3 eye = glm::vec3(0, 0, 1);
 //Global Variable for Camera Look At point:
 glm::vec3 lookAt = glm::vec3(0, 0, 0);
 
+//Global Variable for starting light position (--light):
+glm::vec3 startLightPos = glm::vec3(0.5, 0.5, 0.5);
+
 //Global Variable for Mouse Position:
 glm::vec2 mousePos;
 
@@ -34,13 +48,6 @@ float metallic = 0.0;
 //Global Variable for roughness
 float roughness = 0.1;
 
-// Struct for holding vertex data
-struct Vertex {
-	glm::vec3 position;
-	glm::vec4 color;
-	glm::vec3 normal;
-};
-
 //Struct for holding Pointlight Data
 struct PointLight {
 	glm::vec4 pos;
@@ -50,11 +57,19 @@ struct PointLight {
 //Global light variable
 PointLight light;
 
-// Struct for holding mesh data
-struct Mesh {
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
-};
+//Global debug view (0 = lit, 1 = normals, 2 = albedo, 3 = specular)
+int debugView = 0;
+
+//Global animation clock and current clip
+FixedClock animClock;
+int currentClip = 0;
+bool clipChanged = false;
+
+//Global flag set by a left click (pick at the screen center)
+bool pickRequested = false;
+
+// Vertex buffer binding of the per-instance attributes (the per-vertex ones use their attribute index)
+const GLuint INSTANCE_BINDING = 4;
 
 // Struct for holding OpenGL mesh
 struct MeshGL {
@@ -62,51 +77,71 @@ struct MeshGL {
 	GLuint EBO = 0;
 	GLuint VAO = 0;
 	int indexCnt = 0;
+	int materialIndex = -1;
+	// Instances drawn per instance data entry (number of views)
+	int instanceDivisor = 1;
 };
 
-// Read from file and dump in string
-string readFileToString(string filename) {
-	// Open file
-	ifstream file(filename);
-	// Could we open file?
-	if(!file || file.fail()) {
-		cerr << "ERROR: Could not open file: " << filename << endl;
-		const char *m = ("ERROR: Could not open file: " + filename).c_str();
-		throw runtime_error(m);
-	}
-
-	// Create output stream to receive file data
-	ostringstream outS;
-	outS << file.rdbuf();
-	// Get actual string of file contents
-	string allS = outS.str();
-	// Close file
-	file.close();
-	// Return string
-	return allS;
-}
-
-// Print out shader code
-void printShaderCode(string &vertexCode, string &fragCode) {
-	cout << "***********************" << endl;
-	cout <<"** VERTEX SHADER CODE **" << endl;
-	cout << "***********************" << endl;
-	cout << vertexCode << endl;
-	cout << "*************************" << endl;
-	cout <<"** FRAGMENT SHADER CODE **" << endl;
-	cout << "*************************" << endl;
-	cout << fragCode << endl;
-	cout << "*************************" << endl;
-}
-
-//Convert aiMatrix4x4 to glm::mat4
-void aiMatToGLM4(aiMatrix4x4 &a, glm::mat4 &m) {
-	for(int i = 0; i < 4; i++) {
-		for(int j = 0; j < 4; j++) {
-			m[j][i] = a[i][j];
-		}
-	}
-}
+// Struct for holding per-instance data (one per node that draws a mesh)
+struct InstanceData {
+	glm::mat4 modelMat;
+	glm::mat3 normMat;
+	// First bone matrix of this instance in the palette (-1 if not skinned)
+	int boneOffset = -1;
+};
+
+// Struct for holding material settings used to pick a shader variant
+struct MaterialInfo {
+	// Values from the file (otherwise the interactive metallic/roughness are used)
+	bool hasMetallic = false;
+	float metallic = 0.0f;
+	bool hasRoughness = false;
+	float roughness = 0.1f;
+	bool unlit = false;
+};
+
+// Struct for holding uniform values shared by every variant during a frame
+// (cameras are in the view uniform buffer)
+struct FrameUniforms {
+	long long frame = 0;
+	// Views every instanced draw covers
+	int viewCnt = 1;
+	glm::vec4 lightColor;
+	// Light position in world space and range of the shadow cube maps
+	glm::vec3 shadowLightPos;
+	float shadowFar = 50.0f;
+};
+
+// Struct for holding settings of the software (no GPU) mode
+struct SoftwareSettings {
+	// Image to write (empty = normal OpenGL window)
+	string outFile;
+	int width = 800;
+	int height = 800;
+	// 0 = one thread per core
+	int threadCnt = 0;
+	// Golden image to compare against, and allowed RMS difference (0-255)
+	string goldenFile;
+	float tolerance = 2.0f;
+	// Allow the AVX2 kernels (if the CPU has them)
+	bool useAVX2 = true;
+};
+
+// Struct for holding one instanced draw
+struct DrawBatch {
+	int meshIndex = 0;
+	int baseInstance = 0;
+	int instanceCnt = 0;
+};
+
+// Struct for holding the upscale program (scene target -> window) and its uniform locations
+struct UpscaleProgram {
+	GLuint programID = 0;
+	GLint sceneTexLoc = -1;
+	GLint uvOffsetLoc = -1;
+	GLint uvScaleLoc = -1;
+	GLint sharpnessLoc = -1;
+};
 
 //Print number of tabs given level in tree
 void printTab(int cnt) {
@@ -284,175 +319,9 @@ void checkAndSetupOpenGLDebugging() {
 	}
 }
 
-// GLSL Compiling/Linking Error Check
-// Returns GL_TRUE if compile was successful; GL_FALSE otherwise.
-GLint checkGLSLError(GLuint ID, bool isCompile) {
-
-	GLint resultGL = GL_FALSE;
-	int infoLogLength;
-	char *errorMessage = nullptr;
-
-	if(isCompile) {
-		// Get the compilation status and message length
-		glGetShaderiv(ID, GL_COMPILE_STATUS, &resultGL);	
-		glGetShaderiv(ID, GL_INFO_LOG_LENGTH, &infoLogLength);
-	}
-	else {
-		// Get linking status and message length
-		glGetProgramiv(ID, GL_LINK_STATUS, &resultGL);
-		glGetProgramiv(ID, GL_INFO_LOG_LENGTH, &infoLogLength);
-	}
-
-	// Make sure length is at least one and allocate space for message	
-	infoLogLength = (infoLogLength > 1) ? infoLogLength : 1;
-	errorMessage = new char[infoLogLength];	
-
-	// Get actual message
-	if(isCompile)
-		glGetShaderInfoLog(ID, infoLogLength, NULL, errorMessage);		
-	else	
-		glGetProgramInfoLog(ID, infoLogLength, NULL, errorMessage);
-
-	// Print error message
-	if(infoLogLength > 1)
-		cout << errorMessage << endl;
-
-	// Cleanup
-	if(errorMessage) delete [] errorMessage;
-
-	// Return OpenGL error
-	return resultGL;
-}
-
-// Creates and compiles GLSL shader from code string; returns shader ID
-GLuint createAndCompileShader(const char *shaderCode, GLenum shaderType) {
-	// Create the shader ID
-	GLuint shaderID = glCreateShader(shaderType);
-
-	// Compile the vertex shader...
-	cout << "Compiling shader..." << endl;
-	glShaderSource(shaderID, 1, &shaderCode, NULL);
-	glCompileShader(shaderID);
-
-	// Checking result of compilation...
-	GLint compileOK = checkGLSLError(shaderID, true);
-	if (!compileOK || shaderID == 0) {
-		glDeleteShader(shaderID);		
-		cout << "Error compiling shader." << endl;
-		throw runtime_error("Error compiling shader.");
-	}
-
-	// Return shader ID
-	return shaderID;
-}
-
-// Given a list of compiled shaders, create and link a shader program (ID returned).
-GLuint createAndLinkShaderProgram(std::vector<GLuint> allShaderIDs) {
-
-	// Create program ID and attach shaders
-	cout << "Linking program..." << endl;
-	GLuint programID = glCreateProgram();
-	for (GLuint &shaderID : allShaderIDs) {
-		glAttachShader(programID, shaderID);
-	}
-
-	// Actually link the program
-	glLinkProgram(programID);
-
-	// Detach shaders (program already linked, successful or not)
-	for (GLuint &shaderID : allShaderIDs) {
-		glDetachShader(programID, shaderID);		
-	}
-
-	// Check linking
-	GLint linkOK = checkGLSLError(programID, false);
-	if (!linkOK || programID == 0) {		
-		glDeleteProgram(programID);		
-		cout << "Error linking shaders." << endl;
-		throw runtime_error("Error linking shaders.");
-	}
-
-	// Return program ID
-	return programID;
-}
-
-// Does the following:
-// - Creates and compiles vertex and fragment shaders (from provided code strings)
-// - Creates and links shader program
-// - Deletes vertex and fragment shaders
-GLuint initShaderProgramFromSource(string vertexShaderCode, string fragmentShaderCode) {
-	GLuint vertID = 0;
-	GLuint fragID = 0;
-	GLuint programID = 0;
-
-	try {
-		// Create and compile shaders
-		cout << "Vertex shader: ";
-		vertID = createAndCompileShader(vertexShaderCode.c_str(), GL_VERTEX_SHADER);
-		cout << "Fragment shader: ";
-		fragID = createAndCompileShader(fragmentShaderCode.c_str(), GL_FRAGMENT_SHADER);
-
-		// Create and link program
-		programID = createAndLinkShaderProgram({ vertID, fragID });
-
-		// Delete individual shaders
-		glDeleteShader(vertID);
-		glDeleteShader(fragID);
-
-		// Success!
-		cout << "Program successfully compiled and linked!" << endl;
-	}
-	catch (exception e) {
-		// Cleanup shaders and shader program, just in case
-		if (vertID) glDeleteShader(vertID);
-		if (fragID) glDeleteShader(fragID);		
-		// Rethrow exception
-		throw e;
-	}
-
-	return programID;
-}
-
-void ExtractMeshData(aiMesh *mesh, Mesh &m) {
-	m.vertices.clear();
-	m.indices.clear();
-	for(unsigned int i = 0; i < mesh->mNumVertices; i++){
-		Vertex loopVert;
-		loopVert.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-		loopVert.color = glm::vec4(1.0, 1.0, 0.0, 1.0);
-		loopVert.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-		m.vertices.push_back(loopVert);
-
-	}
-	for(unsigned int j = 0; j < mesh->mNumFaces; j++) {
-		aiFace face;
-		face = mesh->mFaces[j];
-		for(unsigned int k = 0; k < face.mNumIndices; k++) {
-			m.indices.push_back(face.mIndices[k]);
-		}
-
-	}
-}
-
-//Generate Transformation to rotate around arbitrary point and axis:
- glm::mat4 makeLocalRotate(glm::vec3 offset, glm::vec3 axis, float angle) {
-	 glm::mat4 translateNeg = glm::translate(-offset);
-	 glm::mat4 translatePos = glm::translate(offset);
-	 glm::mat4 rotate = glm::rotate(glm::radians(angle), glm::vec3(axis));
-	 glm::mat4 compositeTransformArb = translatePos * rotate * translateNeg;
-
-	 return compositeTransformArb;
- }
-
-//Generate Transformation around local z axis
+//Generate Transformation around local z axis (by the global rotation angle)
 glm::mat4 makeRotateZ(glm::vec3 offset) {
-	glm::mat4 translateNeg = glm::translate(-offset);
-	glm::mat4 translatePos = glm::translate(offset);
-	glm::mat4 rotate = glm::rotate(glm::radians(rotAngle), glm::vec3(0, 0, 1));
-	glm::mat4 compositeTransformZ;
-	compositeTransformZ = translatePos * rotate * translateNeg;
-
-	return compositeTransformZ;
+	return makeRotateZ(offset, rotAngle);
 }
 
 //GlFW Callback Function
@@ -520,9 +389,35 @@ static void keyCallback(GLFWwindow *window, int key, int scancode, int action, i
 		else if (key == GLFW_KEY_4) {
 			light.color = glm::vec4(0, 0, 1, 1); //blue
 		}
+		else if (key == GLFW_KEY_P) {
+			animClock.paused = !animClock.paused;
+		}
+		else if (key == GLFW_KEY_L) {
+			currentClip++;
+			clipChanged = true;
+		}
+		else if (key == GLFW_KEY_F1) {
+			debugView = 0; //lit
+		}
+		else if (key == GLFW_KEY_F2) {
+			debugView = 1; //normals
+		}
+		else if (key == GLFW_KEY_F3) {
+			debugView = 2; //albedo
+		}
+		else if (key == GLFW_KEY_F4) {
+			debugView = 3; //specular
+		}
     }
 }
 
+//Mouse Button Callback Function
+static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+	if(button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+		pickRequested = true;
+	}
+}
+
 //Mouse Callback Function
 static void mouse_position_callback(GLFWwindow* window, double xpos, double ypos) {
 	int fWidth, fHeight;
@@ -610,6 +505,7 @@ void createMeshGL(Mesh &m, MeshGL &mgl) {
 	glEnableVertexAttribArray(0);	// position
 	glEnableVertexAttribArray(1);	// color
 	glEnableVertexAttribArray(2);   // normal
+	glEnableVertexAttribArray(3);   // texcoord
 
 	
 	// Bind the VBO and set up data mappings so that VAO knows how to read it
@@ -621,6 +517,13 @@ void createMeshGL(Mesh &m, MeshGL &mgl) {
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord));
+
+	// 12 = bone IDs (integer), 13 = bone weights
+	glEnableVertexAttribArray(12);
+	glEnableVertexAttribArray(13);
+	glVertexAttribIPointer(12, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIDs));
+	glVertexAttribPointer(13, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, boneWeights));
 
 	
 	// Create Element Buffer Object (EBO)
@@ -638,6 +541,66 @@ void createMeshGL(Mesh &m, MeshGL &mgl) {
 	glBindVertexArray(0);
 }
 
+// Point instanced attributes (model and normal matrix) of a mesh's VAO at the instance buffer
+// They share one buffer binding, so the divisor (views per instance) is changed with a single call
+void setupInstanceAttributes(MeshGL &mgl, GLuint instanceVBO) {
+	glBindVertexArray(mgl.VAO);
+	glBindVertexBuffer(INSTANCE_BINDING, instanceVBO, 0, sizeof(InstanceData));
+	glVertexBindingDivisor(INSTANCE_BINDING, 1);
+	mgl.instanceDivisor = 1;
+
+	// 4-7 = model matrix columns
+	for(int i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(4 + i);
+		glVertexAttribFormat(4 + i, 4, GL_FLOAT, GL_FALSE,
+			(GLuint)(offsetof(InstanceData, modelMat) + i*sizeof(glm::vec4)));
+		glVertexAttribBinding(4 + i, INSTANCE_BINDING);
+	}
+
+	// 8-10 = normal matrix columns
+	for(int i = 0; i < 3; i++) {
+		glEnableVertexAttribArray(8 + i);
+		glVertexAttribFormat(8 + i, 3, GL_FLOAT, GL_FALSE,
+			(GLuint)(offsetof(InstanceData, normMat) + i*sizeof(glm::vec3)));
+		glVertexAttribBinding(8 + i, INSTANCE_BINDING);
+	}
+
+	// 11 = offset into bone palette
+	glEnableVertexAttribArray(11);
+	glVertexAttribIFormat(11, 1, GL_INT, (GLuint)offsetof(InstanceData, boneOffset));
+	glVertexAttribBinding(11, INSTANCE_BINDING);
+
+	glBindVertexArray(0);
+}
+
+// Register diffuse texture of every material with the streamer (-1 if untextured)
+void loadMaterialTextures(const aiScene *scene, string modelDir, TextureStreamer &textures,
+		vector<int> &materialTextures) {
+	materialTextures.assign(scene->mNumMaterials, -1);
+	for(unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		aiMaterial *mat = scene->mMaterials[i];
+		aiString texPath;
+		if(mat->GetTextureCount(aiTextureType_DIFFUSE) == 0 ||
+			mat->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) != aiReturn_SUCCESS) {
+			continue;
+		}
+
+		// Embedded textures are named "*<index>"
+		const aiTexture *embedded = scene->GetEmbeddedTexture(texPath.C_Str());
+		if(embedded) {
+			// Only compressed (png/jpg) embedded images are supported
+			if(embedded->mHeight == 0) {
+				materialTextures[i] = addTextureMemory(textures, texPath.C_Str(),
+					(const unsigned char*)embedded->pcData, embedded->mWidth);
+			}
+		}
+		else {
+			filesystem::path fullPath = filesystem::path(modelDir) / texPath.C_Str();
+			materialTextures[i] = addTextureFile(textures, fullPath.string());
+		}
+	}
+}
+
 // Draw OpenGL mesh
 void drawMesh(MeshGL &mgl) {
 	glBindVertexArray(mgl.VAO);
@@ -645,26 +608,335 @@ void drawMesh(MeshGL &mgl) {
 	glBindVertexArray(0);		
 }
 
-//Render scene Recursively
-void renderScene(vector<MeshGL> &allMeshes, aiNode *node, glm::mat4 parentMat,
-		GLint modelMatLoc, GLint normMatLoc, glm::mat4 viewMat, int level) {
-	aiMatrix4x4 nodeTrans = node->mTransformation;
-	glm::mat4 nodeT;
-	aiMatToGLM4(nodeTrans, nodeT);
-	glm::mat4 modelMat;
-	modelMat = parentMat * nodeT;
-	glm::mat4 R = makeRotateZ(glm::vec3(modelMat[3]));
-	glm::mat4 tmpModel = R * modelMat;
-	glUniformMatrix4fv(modelMatLoc, 1, false, glm::value_ptr(tmpModel));
-	glm::mat4 modelView = viewMat * tmpModel;
-    glm::mat3 normMat = glm::transpose(glm::inverse(glm::mat3(modelView)));
-	glUniformMatrix3fv(normMatLoc, 1, false, glm::value_ptr(normMat));
-	for(unsigned int i = 0; i < node->mNumMeshes; i++) {
-		int index = node->mMeshes[i];
-		drawMesh(allMeshes.at(index));
+// Draw several copies of an OpenGL mesh (instance data starts at baseInstance)
+// Each copy is drawn viewCnt times; Basic.vs picks the view from gl_InstanceID
+void drawMeshInstanced(MeshGL &mgl, int baseInstance, int instanceCnt, int viewCnt) {
+	glBindVertexArray(mgl.VAO);
+	if(mgl.instanceDivisor != viewCnt) {
+		glVertexBindingDivisor(INSTANCE_BINDING, viewCnt);
+		mgl.instanceDivisor = viewCnt;
+	}
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, mgl.indexCnt, GL_UNSIGNED_INT, (void*)0,
+		instanceCnt * viewCnt, baseInstance);
+	glBindVertexArray(0);
+}
+
+//Gather instances of every unique mesh from the flattened scene (and bone matrices of skinned ones)
+void gatherInstances(FlatScene &fs, vector<int> &uniqueOf, vector<MeshSkin> &skins,
+		vector<vector<InstanceData>> &meshInstances, vector<glm::mat4> &bonePalette) {
+	for(SceneNode &node : fs.nodes) {
+		if(node.meshes.empty()) continue;
+		glm::mat4 modelMat = node.globalMat;
+		glm::mat4 R = makeRotateZ(glm::vec3(modelMat[3]));
+
+		for(unsigned int sceneMesh : node.meshes) {
+			// The view matrix is rigid, so the shader finishes the normal matrix with mat3(viewMat)
+			InstanceData inst;
+			MeshSkin &skin = skins.at(sceneMesh);
+			if(skin.bones.empty()) {
+				inst.modelMat = R * modelMat;
+			}
+			else {
+				// Bone matrices already place the vertices in the scene, so only the rotation is left
+				inst.modelMat = R;
+				inst.boneOffset = (int)bonePalette.size();
+				for(SkinBone &bone : skin.bones) {
+					glm::mat4 boneMat = (bone.node >= 0) ? fs.nodes[bone.node].globalMat : glm::mat4(1.0);
+					bonePalette.push_back(boneMat * bone.offsetMat);
+				}
+			}
+			inst.normMat = glm::transpose(glm::inverse(glm::mat3(inst.modelMat)));
+			meshInstances.at(uniqueOf.at(sceneMesh)).push_back(inst);
+		}
+	}
+}
+
+//Gather pickable instances from the flattened scene
+//Skinned meshes are traced in their bind pose placed at the node (the BVH is not refit per frame)
+void gatherPickInstances(FlatScene &fs, vector<int> &uniqueOf, vector<PickInstance> &pickInstances) {
+	for(unsigned int n = 0; n < fs.nodes.size(); n++) {
+		SceneNode &node = fs.nodes[n];
+		glm::mat4 modelMat = node.globalMat;
+		glm::mat4 R = makeRotateZ(glm::vec3(modelMat[3]));
+		for(unsigned int sceneMesh : node.meshes) {
+			PickInstance inst;
+			inst.node = (int)n;
+			inst.sceneMesh = (int)sceneMesh;
+			inst.meshBVH = uniqueOf.at(sceneMesh);
+			inst.modelMat = R * modelMat;
+			pickInstances.push_back(inst);
+		}
+	}
+}
+
+//Upload bone matrices for this frame into the palette SSBO (binding 0)
+void uploadBonePalette(vector<glm::mat4> &bonePalette, GLuint paletteSSBO) {
+	// Never bind an empty buffer
+	if(bonePalette.empty()) bonePalette.push_back(glm::mat4(1.0));
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, paletteSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bonePalette.size()*sizeof(glm::mat4), bonePalette.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, paletteSSBO);
+}
+
+//Upload all instances into the instance buffer and build one draw per unique mesh
+void buildDrawBatches(vector<vector<InstanceData>> &meshInstances, GLuint instanceVBO,
+		vector<InstanceData> &allInstances, vector<DrawBatch> &batches) {
+	allInstances.clear();
+	batches.clear();
+	for(unsigned int i = 0; i < meshInstances.size(); i++) {
+		if(meshInstances[i].empty()) continue;
+		DrawBatch batch;
+		batch.meshIndex = i;
+		batch.baseInstance = (int)allInstances.size();
+		batch.instanceCnt = (int)meshInstances[i].size();
+		allInstances.insert(allInstances.end(), meshInstances[i].begin(), meshInstances[i].end());
+		batches.push_back(batch);
+	}
+
+	// Orphan and refill the buffer each frame
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, allInstances.size()*sizeof(InstanceData), allInstances.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//Gather shadow casters in a fixed order (the same instances the scene draws)
+void gatherShadowCasters(vector<vector<InstanceData>> &meshInstances, vector<MeshBVH> &meshBVHs,
+		vector<ShadowCaster> &casters) {
+	casters.clear();
+	for(unsigned int i = 0; i < meshInstances.size(); i++) {
+		// Mesh bounds are the root of its picking BVH
+		if(meshBVHs[i].nodes.empty() || meshBVHs[i].triangles.empty()) continue;
+		BVHNode &root = meshBVHs[i].nodes[0];
+		for(InstanceData &inst : meshInstances[i]) {
+			ShadowCaster c;
+			c.meshIndex = i;
+			c.modelMat = inst.modelMat;
+			c.boneOffset = inst.boneOffset;
+			c.localMin = glm::vec3(root.bmin[0], root.bmin[1], root.bmin[2]);
+			c.localMax = glm::vec3(root.bmax[0], root.bmax[1], root.bmax[2]);
+			casters.push_back(c);
+		}
+	}
+}
+
+//Re-render the dirty cube faces of each shadow layer (one layered draw per unique mesh)
+void renderPointShadow(PointShadow &ps, vector<MeshGL> &allMeshes, GLuint instanceVBO,
+		vector<vector<InstanceData>> &shadowInstances, vector<InstanceData> &allInstances,
+		vector<DrawBatch> &batches) {
+	ShadowLayer layers[SHADOW_LAYER_CNT] = { SHADOW_STATIC, SHADOW_DYNAMIC };
+	for(ShadowLayer layer : layers) {
+		unsigned int dirty = ps.dirtyFaces[layer];
+		if(!beginShadowLayer(ps, layer)) continue;
+
+		// Only casters of this layer that touch a dirty face
+		for(vector<InstanceData> &instances : shadowInstances) instances.clear();
+		for(ShadowCaster &c : ps.casters) {
+			if(c.layer != layer || !(c.faceMask & dirty)) continue;
+			InstanceData inst;
+			inst.modelMat = c.modelMat;
+			inst.boneOffset = c.boneOffset;
+			shadowInstances.at(c.meshIndex).push_back(inst);
+		}
+		buildDrawBatches(shadowInstances, instanceVBO, allInstances, batches);
+		for(DrawBatch &batch : batches) {
+			drawMeshInstanced(allMeshes.at(batch.meshIndex), batch.baseInstance, batch.instanceCnt, 1);
+		}
+	}
+	endPointShadow(ps);
+}
+
+//Camera of a view: the interactive camera turned around its look-at point (view 0 is the interactive camera)
+glm::mat4 makeViewCamera(int view, int viewCnt) {
+	glm::mat4 turn = makeLocalRotate(lookAt, glm::vec3(0,1,0), 360.0f * view / viewCnt);
+	glm::vec3 viewEye = glm::vec3(turn * glm::vec4(eye, 1.0));
+	return glm::lookAt(viewEye, lookAt, glm::vec3(0,1,0));
+}
+
+//Keep the instances that are inside at least one view (one pass over the scene for all views)
+//Skinned instances are always kept, since their bounds are only known in the bind pose
+int cullInstances(vector<vector<InstanceData>> &meshInstances, vector<MeshBVH> &meshBVHs, ViewBlock &vb,
+		vector<vector<InstanceData>> &visibleInstances) {
+	glm::mat4 viewProjs[MAX_VIEWS];
+	for(int v = 0; v < vb.viewCnt; v++) {
+		viewProjs[v] = vb.views[v].projMat * vb.views[v].viewMat;
+	}
+
+	int culledCnt = 0;
+	for(unsigned int i = 0; i < meshInstances.size(); i++) {
+		visibleInstances[i].clear();
+		bool hasBounds = !meshBVHs[i].nodes.empty() && !meshBVHs[i].triangles.empty();
+		for(InstanceData &inst : meshInstances[i]) {
+			bool visible = !hasBounds || inst.boneOffset >= 0;
+			for(int v = 0; v < vb.viewCnt && !visible; v++) {
+				// Outside if all eight corners are beyond the same clip plane
+				BVHNode &root = meshBVHs[i].nodes[0];
+				glm::mat4 mvp = viewProjs[v] * inst.modelMat;
+				unsigned int outsideAll = 0x3F;
+				for(int corner = 0; corner < 8; corner++) {
+					glm::vec4 p((corner & 1) ? root.bmax[0] : root.bmin[0],
+						(corner & 2) ? root.bmax[1] : root.bmin[1],
+						(corner & 4) ? root.bmax[2] : root.bmin[2], 1.0f);
+					glm::vec4 clip = mvp * p;
+					unsigned int outside = 0;
+					if(clip.x < -clip.w) outside |= 1;
+					if(clip.x > clip.w) outside |= 2;
+					if(clip.y < -clip.w) outside |= 4;
+					if(clip.y > clip.w) outside |= 8;
+					if(clip.z < -clip.w) outside |= 16;
+					if(clip.z > clip.w) outside |= 32;
+					outsideAll &= outside;
+				}
+				visible = (outsideAll == 0);
+			}
+			if(visible) visibleInstances[i].push_back(inst);
+			else culledCnt++;
+		}
 	}
-	for(unsigned int j = 0; j < node->mNumChildren; j++)
-		renderScene(allMeshes, node->mChildren[j], modelMat, modelMatLoc, normMatLoc, viewMat, level+1);
+	return culledCnt;
+}
+
+//Read metallic/roughness/unlit settings of every material
+void loadMaterialInfo(const aiScene *scene, vector<MaterialInfo> &materials) {
+	materials.assign(scene->mNumMaterials, MaterialInfo());
+	for(unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		aiMaterial *mat = scene->mMaterials[i];
+		MaterialInfo &info = materials[i];
+#ifdef AI_MATKEY_METALLIC_FACTOR
+		info.hasMetallic = (mat->Get(AI_MATKEY_METALLIC_FACTOR, info.metallic) == aiReturn_SUCCESS);
+		info.hasRoughness = (mat->Get(AI_MATKEY_ROUGHNESS_FACTOR, info.roughness) == aiReturn_SUCCESS);
+#endif
+		int shadingModel = 0;
+		if(mat->Get(AI_MATKEY_SHADING_MODEL, shadingModel) == aiReturn_SUCCESS) {
+			info.unlit = (shadingModel == aiShadingMode_NoShading);
+		}
+	}
+}
+
+//Round material values so tiny drift does not change the variant
+float quantizeMaterial(float value) {
+	return glm::clamp(round(value * 100.0f) / 100.0f, 0.0f, 1.0f);
+}
+
+//Pick the cheapest shader variant that can draw a material
+unsigned int chooseVariantFlags(MaterialInfo &mat, float matMetallic, bool textured) {
+	unsigned int flags = textured ? VARIANT_TEXTURED : 0;
+	if(debugView == 1) return flags | VARIANT_DEBUG_NORMALS;
+	if(debugView == 2) return flags | VARIANT_DEBUG_ALBEDO;
+	if(debugView == 3) return flags | VARIANT_DEBUG_SPECULAR | VARIANT_BRDF_LUT;
+	if(mat.unlit) return flags | VARIANT_UNLIT;
+
+	// Both values come from the file: bake them in as constants (the interactive values stay uniforms)
+	// No lookup table here: with a constant roughness the geometry term's k folds away at compile time
+	if(mat.hasMetallic && mat.hasRoughness) return flags | VARIANT_FIXED_MATERIAL;
+
+	// Roughness is a uniform: the geometry term is read from the lookup table instead
+	flags |= VARIANT_BRDF_LUT;
+	if(matMetallic <= 0.0f) flags |= VARIANT_DIELECTRIC;
+	else if(matMetallic >= 1.0f) flags |= VARIANT_METAL;
+	return flags;
+}
+
+//Build every variant chooseVariantFlags can pick, so nothing is compiled while a frame is drawn
+void precompileShaderVariants(ShaderVariantCache &cache, vector<MaterialInfo> &materials) {
+	unsigned int common[] = {
+		VARIANT_BRDF_LUT,
+		VARIANT_BRDF_LUT | VARIANT_DIELECTRIC,
+		VARIANT_BRDF_LUT | VARIANT_METAL,
+		VARIANT_UNLIT,
+		VARIANT_DEBUG_NORMALS,
+		VARIANT_DEBUG_ALBEDO,
+		VARIANT_DEBUG_SPECULAR | VARIANT_BRDF_LUT
+	};
+	for(unsigned int flags : common) {
+		getShaderVariant(cache, flags, 0.0f, 0.0f);
+		getShaderVariant(cache, flags | VARIANT_TEXTURED, 0.0f, 0.0f);
+	}
+
+	// One fixed-material variant per distinct pair of values in the file
+	for(MaterialInfo &mat : materials) {
+		if(!mat.hasMetallic || !mat.hasRoughness || mat.unlit) continue;
+		float matMetallic = quantizeMaterial(mat.metallic);
+		float matRoughness = quantizeMaterial(mat.roughness);
+		getShaderVariant(cache, VARIANT_FIXED_MATERIAL, matMetallic, matRoughness);
+		getShaderVariant(cache, VARIANT_FIXED_MATERIAL | VARIANT_TEXTURED, matMetallic, matRoughness);
+	}
+}
+
+//Activate a variant, setting the per-frame uniforms the first time it is used this frame
+void useShaderVariant(ShaderVariant &variant, FrameUniforms &fu) {
+	glUseProgram(variant.programID);
+	if(variant.frameSet == fu.frame) return;
+	variant.frameSet = fu.frame;
+
+	glUniform4fv(variant.lightColorLoc, 1, glm::value_ptr(fu.lightColor));
+
+	glUniform3fv(variant.shadowLightPosLoc, 1, glm::value_ptr(fu.shadowLightPos));
+	glUniform1f(variant.shadowFarLoc, fu.shadowFar);
+
+	//Diffuse texture on unit 0, BRDF lookup table on unit 1, shadow cube maps on units 2 and 3
+	glUniform1i(variant.diffuseTexLoc, 0);
+	glUniform1i(variant.brdfLutLoc, 1);
+	glUniform1i(variant.shadowStaticLoc, 2);
+	glUniform1i(variant.shadowDynamicLoc, 3);
+}
+
+//Render scene: one instanced draw per unique mesh, each with the cheapest shader variant
+void renderScene(vector<MeshGL> &allMeshes, vector<DrawBatch> &batches,
+		TextureStreamer &textures, vector<int> &materialTextures, vector<MaterialInfo> &materials,
+		ShaderVariantCache &shaderVariants, FrameUniforms &fu) {
+	ShaderVariant *current = nullptr;
+	for(DrawBatch &batch : batches) {
+		MeshGL &mgl = allMeshes.at(batch.meshIndex);
+
+		// Bind diffuse texture if it has been streamed in (otherwise just vertex color)
+		GLuint texID = 0;
+		if(mgl.materialIndex >= 0 && mgl.materialIndex < (int)materialTextures.size()) {
+			texID = getTextureGL(textures, materialTextures[mgl.materialIndex]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texID);
+
+		// Material values (from the file, or the interactive ones)
+		MaterialInfo mat;
+		if(mgl.materialIndex >= 0 && mgl.materialIndex < (int)materials.size()) {
+			mat = materials[mgl.materialIndex];
+		}
+		float matMetallic = quantizeMaterial(mat.hasMetallic ? mat.metallic : metallic);
+		float matRoughness = quantizeMaterial(mat.hasRoughness ? mat.roughness : roughness);
+
+		// Never compile here: a missing variant is queued for the next frame and the batch skipped
+		unsigned int flags = chooseVariantFlags(mat, matMetallic, texID != 0);
+		ShaderVariant *variant = findShaderVariant(shaderVariants, flags, matMetallic, matRoughness);
+		if(!variant || !variant->programID) continue;
+		if(variant != current) {
+			useShaderVariant(*variant, fu);
+			current = variant;
+		}
+		glUniform1f(variant->metalLoc, matMetallic);
+		glUniform1f(variant->roughLoc, matRoughness);
+
+		drawMeshInstanced(mgl, batch.baseInstance, batch.instanceCnt, fu.viewCnt);
+	}
+}
+
+//Upscale a window's part of the scene target into the window (the window's context must be current)
+void presentViewWindow(ViewWindow &vw, RenderTarget &sceneTarget, UpscaleProgram &upscale, float sharpness) {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, vw.width, vw.height);
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(upscale.programID);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sceneTarget.colorTex);
+	glUniform1i(upscale.sceneTexLoc, 0);
+	glUniform2f(upscale.uvOffsetLoc, (float)vw.targetX / sceneTarget.allocWidth, 0.0f);
+	glUniform2f(upscale.uvScaleLoc, (float)vw.targetWidth / sceneTarget.allocWidth,
+		(float)vw.targetHeight / sceneTarget.allocHeight);
+	glUniform1f(upscale.sharpnessLoc, sharpness);
+	glBindVertexArray(vw.emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 // Cleanup OpenGL mesh
@@ -685,6 +957,89 @@ void cleanupMesh(MeshGL &mgl) {
 	mgl.indexCnt = 0;
 }
 
+//Render one image on the CPU (no window or OpenGL context) and optionally compare it to a golden image
+int renderSoftwareImage(const aiScene *scene, SoftwareSettings &ss) {
+	//Same scene setup as the OpenGL path
+	light.pos = glm::vec4(startLightPos, 1);
+	light.color = glm::vec4(1, 1, 1, 1);
+	vector<MaterialInfo> materials;
+	loadMaterialInfo(scene, materials);
+
+	FlatScene flatScene;
+	flattenScene(scene->mRootNode, flatScene);
+	vector<MeshSkin> skins;
+	loadMeshSkins(scene, flatScene, skins);
+	updateGlobalTransforms(flatScene);
+
+	MeshDedup dedup;
+	for(unsigned int cnt = 0; cnt < scene->mNumMeshes; cnt++) {
+		Mesh loopMesh;
+		ExtractMeshData(scene->mMeshes[cnt], loopMesh);
+		addDedupMesh(dedup, loopMesh);
+	}
+
+	vector<vector<InstanceData>> meshInstances(dedup.uniqueMeshes.size());
+	vector<glm::mat4> bonePalette;
+	gatherInstances(flatScene, dedup.uniqueOf, skins, meshInstances, bonePalette);
+
+	//One draw item per instance
+	vector<SoftDrawItem> items;
+	for(unsigned int i = 0; i < meshInstances.size(); i++) {
+		Mesh &mesh = dedup.uniqueMeshes[i];
+		MaterialInfo mat;
+		if(mesh.materialIndex >= 0 && mesh.materialIndex < (int)materials.size()) {
+			mat = materials[mesh.materialIndex];
+		}
+		for(InstanceData &inst : meshInstances[i]) {
+			SoftDrawItem item;
+			item.mesh = &mesh;
+			item.modelMat = inst.modelMat;
+			item.normMat = inst.normMat;
+			item.bones = (inst.boneOffset >= 0) ? &bonePalette[inst.boneOffset] : nullptr;
+			item.metallic = quantizeMaterial(mat.hasMetallic ? mat.metallic : metallic);
+			item.roughness = quantizeMaterial(mat.hasRoughness ? mat.roughness : roughness);
+			item.unlit = mat.unlit;
+			items.push_back(item);
+		}
+	}
+
+	//Same camera as the first frame of the window
+	SoftFrame frame;
+	frame.viewMat = glm::lookAt(eye, lookAt, glm::vec3(0,1,0));
+	frame.projMat = glm::perspective(glm::radians(90.0f), (float)ss.width / ss.height, 0.01f, 50.0f);
+	frame.lightPos = frame.viewMat * light.pos;
+	frame.lightColor = light.color;
+	frame.clearColor = glm::vec4(0.64f, 0.93f, 0.4f, 1.0f);
+
+	SoftRasterizer sr;
+	createSoftRasterizer(sr, ss.threadCnt);
+	if(!ss.useAVX2) sr.useAVX2 = false;
+	SoftFramebuffer fb;
+	resizeSoftFramebuffer(fb, ss.width, ss.height);
+	renderSoftware(sr, items, frame, fb);
+	cout << "Software render: " << sr.stats.triangleCnt << " triangles on " << sr.threadCnt << " threads";
+	cout << (sr.useAVX2 ? " with AVX2 (" : " (");
+	cout << "vertex " << sr.stats.vertexMs << " ms, bin " << sr.stats.binMs << " ms, raster ";
+	cout << sr.stats.rasterMs << " ms)" << endl;
+
+	if(!writeSoftFramebufferPNG(fb, ss.outFile)) {
+		cerr << "Error: could not write " << ss.outFile << endl;
+		return 1;
+	}
+
+	//Compare against golden image
+	if(!ss.goldenFile.empty()) {
+		double rmse = compareWithGolden(fb, ss.goldenFile);
+		if(rmse < 0.0) {
+			cerr << "Error: could not compare with " << ss.goldenFile << endl;
+			return 1;
+		}
+		cout << "RMS difference to " << ss.goldenFile << ": " << rmse << endl;
+		if(rmse > ss.tolerance) return 1;
+	}
+	return 0;
+}
+
 // Main 
 int main(int argc, char **argv) {
 	
@@ -694,18 +1049,78 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	//Optional settings after the model: --budget <GPU ms per frame> (0 = always full resolution)
+	//--windows <n> (windows sharing one set of GPU resources), --views <n> (views per window)
+	//--eye <x> <y> <z> (starting camera position; the camera looks at the origin), --light <x> <y> <z>
+	//Software mode: --software <out.png> [--size <w> <h>] [--threads <n>] [--golden <png>] [--tolerance <rms>]
+	//               [--no-avx2]
+	DynamicResolution dynRes;
+	SoftwareSettings software;
+	int windowCnt = 1;
+	int viewsPerWindow = 1;
+	for(int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if(arg == "--no-avx2") {
+			software.useAVX2 = false;
+			continue;
+		}
+
+		//The other options take a value
+		if(i + 1 >= argc) break;
+		if(arg == "--budget") {
+			dynRes.budgetMs = (float)atof(argv[++i]);
+		}
+		else if(arg == "--windows") {
+			windowCnt = max(1, atoi(argv[++i]));
+		}
+		else if(arg == "--views") {
+			viewsPerWindow = max(1, atoi(argv[++i]));
+		}
+		else if(arg == "--eye" && i + 3 < argc) {
+			eye.x = (float)atof(argv[++i]);
+			eye.y = (float)atof(argv[++i]);
+			eye.z = (float)atof(argv[++i]);
+		}
+		else if(arg == "--light" && i + 3 < argc) {
+			startLightPos.x = (float)atof(argv[++i]);
+			startLightPos.y = (float)atof(argv[++i]);
+			startLightPos.z = (float)atof(argv[++i]);
+		}
+		else if(arg == "--software") {
+			software.outFile = argv[++i];
+		}
+		else if(arg == "--size" && i + 2 < argc) {
+			software.width = max(1, atoi(argv[++i]));
+			software.height = max(1, atoi(argv[++i]));
+		}
+		else if(arg == "--threads") {
+			software.threadCnt = atoi(argv[++i]);
+		}
+		else if(arg == "--golden") {
+			software.goldenFile = argv[++i];
+		}
+		else if(arg == "--tolerance") {
+			software.tolerance = (float)atof(argv[++i]);
+		}
+	}
+
 	//Create the model importer
 	Assimp::Importer importer;
 
 	//Load model
-	const aiScene *scene = importer.ReadFile(argv[1], aiProcess_Triangulate || aiProcess_FlipUVs ||
-		 aiProcess_GenNormals || aiProcess_JoinIdenticalVertices);
+	const aiScene *scene = importer.ReadFile(argv[1], aiProcess_Triangulate | aiProcess_FlipUVs |
+		 aiProcess_GenNormals | aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights);
 
 	//Check Model loaded correctly
-	if(!scene || scene->mFlags && AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+	if(!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
 		cerr << "Error: " << importer.GetErrorString() << endl;
 		exit(1);
 	}
+
+	//No GPU needed: render on the CPU and exit
+	if(!software.outFile.empty()) {
+		return renderSoftwareImage(scene, software);
+	}
 		
 	vector<MeshGL> meshVector;
 
@@ -735,24 +1150,54 @@ int main(int argc, char **argv) {
 	//Set Mouse Cursor Motion Function
 	glfwSetCursorPosCallback(window, mouse_position_callback);
 
+	//Set Mouse Button Function
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
+
 	//Hide the mouse
 	 glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	//All views are drawn in one pass, so their number is limited by the view uniform buffer
+	if(windowCnt * viewsPerWindow > MAX_VIEWS) {
+		windowCnt = min(windowCnt, MAX_VIEWS);
+		viewsPerWindow = MAX_VIEWS / windowCnt;
+		cout << "At most " << MAX_VIEWS << " views; using " << windowCnt << " windows with ";
+		cout << viewsPerWindow << " views each" << endl;
+	}
+
+	//Extra windows share buffers, programs and textures with this one (the scene is only loaded once)
+	vector<ViewWindow> viewWindows(1);
+	viewWindows[0].window = window;
+	viewWindows[0].viewCnt = viewsPerWindow;
+	for(int w = 1; w < windowCnt; w++) {
+		ViewWindow vw;
+		createViewWindow(vw, window, 800, 800, "I Can See the Code Morpheus (window " + to_string(w + 1) + ")");
+		if(!vw.window) break;
+		glfwSetKeyCallback(vw.window, keyCallback);
+		vw.viewCnt = viewsPerWindow;
+		vw.firstView = w * viewsPerWindow;
+		viewWindows.push_back(vw);
+	}
+	int totalViewCnt = (int)viewWindows.size() * viewsPerWindow;
+
 	// Set the background color to a shade of blue
 	glClearColor(0.64f, 0.93f, 0.4f, 1.0f);	
 
-	// Create and load shader
-	GLuint programID = 0;
+	//Material settings; materials with metallic and roughness in the file use the fixed-material variant
+	vector<MaterialInfo> materials;
+	loadMaterialInfo(scene, materials);
+
+	// Load shader code and build every variant the materials and debug views can use
+	ShaderVariantCache shaderVariants;
 	try {		
 		// Load vertex shader code and fragment shader code
-		string vertexCode = readFileToString("./Basic.vs");
-		string fragCode = readFileToString("./Basic.fs");
+		shaderVariants.vertexCode = readFileToString("./Basic.vs");
+		shaderVariants.fragCode = readFileToString("./Basic.fs");
 
 		// Print out shader code, just to check
-		if(DEBUG_MODE) printShaderCode(vertexCode, fragCode);
+		if(DEBUG_MODE) printShaderCode(shaderVariants.vertexCode, shaderVariants.fragCode);
 
-		// Create shader program from code
-		programID = initShaderProgramFromSource(vertexCode, fragCode);
+		// Create shader programs from code
+		precompileShaderVariants(shaderVariants, materials);
 	}
 	catch (exception e) {		
 		// Close program
@@ -760,47 +1205,143 @@ int main(int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 
-	//Do light stuff
-	light.pos = glm::vec4(0.5, 0.5, 0.5, 1);
-	light.color = glm::vec4(1, 1, 1, 1);
-	
-
-	//Get View Matrix Location
-	GLint viewMatLoc = glGetUniformLocation(programID, "viewMat");
+	// Create upscale shader (low resolution scene -> window)
+	UpscaleProgram upscale;
+	try {
+		string vertexCode = readFileToString("./Upscale.vs");
+		string fragCode = readFileToString("./Upscale.fs");
+		upscale.programID = initShaderProgramFromSource(vertexCode, fragCode);
+	}
+	catch (const exception &) {
+		cleanupGLFW(window);
+		exit(EXIT_FAILURE);
+	}
+	upscale.sceneTexLoc = glGetUniformLocation(upscale.programID, "sceneTex");
+	upscale.uvOffsetLoc = glGetUniformLocation(upscale.programID, "uvOffset");
+	upscale.uvScaleLoc = glGetUniformLocation(upscale.programID, "uvScale");
+	upscale.sharpnessLoc = glGetUniformLocation(upscale.programID, "sharpness");
 
-	//Get Projection Matrix Location
-	GLint projMatLoc = glGetUniformLocation(programID, "projMat");
+	// Create layered shadow shader (all six cube faces in one pass)
+	PointShadow pointShadow;
+	try {
+		string vertexCode = readFileToString("./Shadow.vs");
+		string geomCode = readFileToString("./Shadow.gs");
+		string fragCode = readFileToString("./Shadow.fs");
+		createPointShadow(pointShadow, 1024, 50.0f, initShaderProgramFromSource(vertexCode, geomCode, fragCode));
+	}
+	catch (const exception &) {
+		cleanupGLFW(window);
+		exit(EXIT_FAILURE);
+	}
 
-	//Get model matrix location
-	GLint modelMatLoc = glGetUniformLocation(programID, "modelMat");
+	// Empty VAO for the fullscreen triangle (core profile needs one bound)
+	glGenVertexArrays(1, &viewWindows[0].emptyVAO);
 
-	//Get light info location
-	GLint lightPosLoc = glGetUniformLocation(programID, "light.pos");
-	GLint lightColorLoc = glGetUniformLocation(programID, "light.color");
+	// Offscreen target whose used size follows measured GPU time (every window's views, side by side)
+	RenderTarget sceneTarget;
+	GPUTimer sceneTimer;
+	createGPUTimer(sceneTimer);
 
-	//Get normal matrix location
-	GLint normMatLoc = glGetUniformLocation(programID, "normMat");
+	//Do light stuff
+	light.pos = glm::vec4(startLightPos, 1);
+	light.color = glm::vec4(1, 1, 1, 1);
 	
-	//Get Metallic and Roughness Uniform Location
-	GLint metalLoc = glGetUniformLocation(programID, "metallic");
-	GLint roughLoc = glGetUniformLocation(programID, "roughness");
 
-	cout << modelMatLoc << endl;
-	cout << lightPosLoc << " " << lightColorLoc << " " << normMatLoc << endl;
+	//Precompute the geometry and Fresnel terms of the BRDF
+	GLuint brdfLutID = createBRDFLut(128);
+
+	FrameUniforms frameUniforms;
+
+	//Cameras of all views (refilled every frame)
+	ViewBlock viewBlock;
+	vector<ViewRect> viewRects;
+	GLuint viewUBO = 0;
+	glGenBuffers(1, &viewUBO);
 	
 	// Create simple quad
 	Mesh m;
 	createSimpleQuad(m);
 
-	//Fill our new Vector
+	//Flatten the node tree and load animations and skins
+	FlatScene flatScene;
+	flattenScene(scene->mRootNode, flatScene);
+	vector<AnimationClip> clips;
+	loadAnimations(scene, flatScene, clips);
+	vector<MeshSkin> skins;
+	loadMeshSkins(scene, flatScene, skins);
+	cout << "Animations: " << clips.size() << endl;
+
+	//Collapse byte-identical meshes (e.g. every bolt in a CAD assembly)
+	MeshDedup dedup;
 	for(unsigned int cnt = 0; cnt < scene->mNumMeshes; cnt++) {
 		Mesh loopMesh;
-		MeshGL loopMeshGl;
 		ExtractMeshData(scene->mMeshes[cnt], loopMesh);
-		createMeshGL(loopMesh, loopMeshGl);
+		addDedupMesh(dedup, loopMesh);
+	}
+
+	//Buffer holding per-instance transforms (refilled every frame)
+	GLuint instanceVBO = 0;
+	glGenBuffers(1, &instanceVBO);
+
+	//Buffer holding bone matrices of all skinned instances (refilled every frame)
+	GLuint paletteSSBO = 0;
+	glGenBuffers(1, &paletteSSBO);
+	vector<glm::mat4> bonePalette;
+
+	//Fill our new Vector (one OpenGL mesh per unique mesh)
+	for(unsigned int cnt = 0; cnt < dedup.uniqueMeshes.size(); cnt++) {
+		MeshGL loopMeshGl;
+		createMeshGL(dedup.uniqueMeshes[cnt], loopMeshGl);
+		setupInstanceAttributes(loopMeshGl, instanceVBO);
+		loopMeshGl.materialIndex = dedup.uniqueMeshes[cnt].materialIndex;
 		meshVector.push_back(loopMeshGl);
 	}
 
+	//Report what deduplication and instancing saved
+	vector<vector<InstanceData>> meshInstances(meshVector.size());
+	gatherInstances(flatScene, dedup.uniqueOf, skins, meshInstances, bonePalette);
+	int nodeDrawCnt = 0;
+	int batchCnt = 0;
+	for(vector<InstanceData> &instances : meshInstances) {
+		nodeDrawCnt += (int)instances.size();
+		if(!instances.empty()) batchCnt++;
+	}
+	cout << "Unique meshes: " << dedup.uniqueMeshes.size() << " / " << scene->mNumMeshes << endl;
+	cout << "GPU memory saved by deduplication: " << dedup.savedBytes / 1024 << " KB" << endl;
+	cout << "Draws merged by instancing: " << nodeDrawCnt - batchCnt;
+	cout << " (" << nodeDrawCnt << " -> " << batchCnt << ")" << endl;
+	vector<InstanceData> allInstances;
+	vector<DrawBatch> batches;
+	vector<vector<InstanceData>> visibleInstances(meshVector.size());
+	long long culledCnt = 0;
+	long long frameCnt = 0;
+
+	//Build a triangle BVH per unique mesh for picking
+	double bvhStart = glfwGetTime();
+	vector<MeshBVH> meshBVHs(dedup.uniqueMeshes.size());
+	size_t bvhBytes = 0;
+	size_t triCnt = 0;
+	for(unsigned int cnt = 0; cnt < dedup.uniqueMeshes.size(); cnt++) {
+		buildMeshBVH(dedup.uniqueMeshes[cnt], meshBVHs[cnt]);
+		bvhBytes += meshBVHBytes(meshBVHs[cnt]);
+		triCnt += meshBVHs[cnt].triangles.size();
+	}
+	cout << "Picking BVH: " << triCnt << " triangles, " << bvhBytes / 1024 << " KB, built in ";
+	cout << (glfwGetTime() - bvhStart) * 1000.0 << " ms" << endl;
+	vector<PickInstance> pickInstances;
+	SceneBVH sceneBVH;
+
+	//Shadow casters and their draw lists (only dirty cube faces are re-rendered)
+	vector<ShadowCaster> shadowCasters;
+	vector<vector<InstanceData>> shadowInstances(meshVector.size());
+
+	//Start streaming textures (decoded on worker threads, uploaded a few per frame)
+	TextureStreamer textures;
+	startTextureStreamer(textures, TextureSettings());
+	vector<int> materialTextures;
+	string modelDir = filesystem::path(argv[1]).parent_path().string();
+	loadMaterialTextures(scene, modelDir, textures, materialTextures);
+
 	// Create OpenGL mesh (VAO) from data
 	MeshGL mgl;
 	createMeshGL(m, mgl);
@@ -808,56 +1349,167 @@ int main(int argc, char **argv) {
 	// Enable depth testing
 	glEnable(GL_DEPTH_TEST);
 
-	while (!glfwWindowShouldClose(window)) {
-		// Set viewport size
-		int fwidth, fheight;
-		glfwGetFramebufferSize(window, &fwidth, &fheight);
-		glViewport(0, 0, fwidth, fheight);
-
-		// Clear the framebuffer
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Use shader program
-		glUseProgram(programID);
+	double lastTime = glfwGetTime();
+
+	while (!anyViewWindowShouldClose(viewWindows)) {
+		//Advance animation in fixed steps and pose the scene
+		double currentTime = glfwGetTime();
+		int animSteps = advanceClock(animClock, currentTime - lastTime);
+		lastTime = currentTime;
+		//The pose (and so the bone palette) only changes when the clock steps or the clip restarts
+		bool poseChanged = false;
+		if(!clips.empty()) {
+			poseChanged = (animSteps > 0 || clipChanged);
+			if(clipChanged) {
+				currentClip %= (int)clips.size();
+				resetToRestPose(flatScene);
+				animClock.time = 0.0;
+				clipChanged = false;
+				cout << "Playing animation: " << clips[currentClip].name << endl;
+			}
+			sampleAnimation(clips[currentClip], animClock.time, flatScene);
+		}
+		updateGlobalTransforms(flatScene);
+
+		//Pick what is under the crosshair (the cursor is hidden, so always the screen center)
+		if(pickRequested) {
+			pickRequested = false;
+			pickInstances.clear();
+			gatherPickInstances(flatScene, dedup.uniqueOf, pickInstances);
+			double pickStart = glfwGetTime();
+			buildSceneBVH(pickInstances, meshBVHs, sceneBVH);
+			PickHit hit = pickScene(sceneBVH, meshBVHs, eye, lookAt - eye);
+			double pickMs = (glfwGetTime() - pickStart) * 1000.0;
+			if(hit.hit) {
+				cout << "Picked node \"" << flatScene.nodes[hit.node].name << "\", mesh " << hit.sceneMesh;
+				cout << ", triangle " << hit.triangle << " at distance " << hit.distance;
+			}
+			else {
+				cout << "Picked nothing";
+			}
+			cout << " (" << pickMs << " ms)" << endl;
+		}
 
-		//Pass View matrix to shader
-		glm::mat4 viewMat = glm::lookAt(eye, lookAt, glm::vec3(0,1,0));
-		glUniformMatrix4fv(viewMatLoc, 1, false, glm::value_ptr(viewMat));
+		//Upload any textures that finished decoding
+		updateTextureStreamer(textures);
 
-		//Pass in current Metallic and Roughness Values
-		glUniform1f(metalLoc, metallic);
-		glUniform1f(roughLoc, roughness);		
+		//Build variants the last frame was missing (before the frame is timed)
+		buildPendingShaderVariants(shaderVariants);
 
-		//Get Framebuffer size
-		int fBuffW, fBuffH;
-		float aspectRatio;
-		glfwGetFramebufferSize(window, &fBuffW, &fBuffH);
-		if(fBuffW == 0 || fBuffH == 0) {
-			aspectRatio = 1.0;
-		}
-		else {
-			aspectRatio = (float)fBuffW / fBuffH;
+		//Adjust resolution from the most recent GPU time
+		if(readGPUTimer(sceneTimer)) {
+			updateDynamicResolution(dynRes, sceneTimer.lastMs);
 		}
 
-		glm::mat4 projMat = glm::perspective(glm::radians(90.0f), aspectRatio, 0.01f, 50.0f);
-		glUniformMatrix4fv(projMatLoc, 1, false, glm::value_ptr(projMat));
+		//Gather instances
+		for(vector<InstanceData> &instances : meshInstances) instances.clear();
+		bonePalette.clear();
+		gatherInstances(flatScene, dedup.uniqueOf, skins, meshInstances, bonePalette);
+		uploadBonePalette(bonePalette, paletteSSBO);
+
+		//Update shadow faces whose casters (or the light) moved; done before the scene timer starts, so the
+		//shadow pass does not count against the dynamic resolution budget
+		gatherShadowCasters(meshInstances, meshBVHs, shadowCasters);
+		updatePointShadow(pointShadow, glm::vec3(light.pos), shadowCasters, poseChanged);
+		renderPointShadow(pointShadow, meshVector, instanceVBO, shadowInstances, allInstances, batches);
+
+		//Lay out every window's views side by side in the offscreen target (scaled part of it)
+		int targetW, targetH, sceneW, sceneH;
+		layoutViewWindows(viewWindows, dynRes.scale, targetW, targetH, sceneW, sceneH);
+
+		//Camera, light position (view space) and viewport of every view
+		viewBlock.viewCnt = 0;
+		for(ViewWindow &vw : viewWindows) {
+			layoutViewRects(vw, viewRects);
+			for(int i = 0; i < vw.viewCnt; i++) {
+				ViewUniforms &view = viewBlock.views[viewBlock.viewCnt++];
+				view.viewMat = makeViewCamera(vw.firstView + i, totalViewCnt);
+				view.projMat = glm::perspective(glm::radians(90.0f), viewRects[i].aspect, 0.01f, 50.0f);
+				view.lightPos = view.viewMat * light.pos;
+				view.clipRect = makeClipRect(viewRects[i], sceneW, sceneH);
+			}
+		}
+		uploadViewBlock(viewBlock, viewUBO);
+
+		//Per-frame uniforms (each variant picks these up the first time it is used)
+		frameUniforms.frame++;
+		frameUniforms.viewCnt = viewBlock.viewCnt;
+		frameUniforms.lightColor = light.color;
+		frameUniforms.shadowLightPos = glm::vec3(light.pos);
+		frameUniforms.shadowFar = pointShadow.farPlane;
+
+		//Cull once against all views and upload the instances; every view is drawn in the same instanced draws
+		//(Basic.vs clips each copy to its own viewport)
+		culledCnt += cullInstances(meshInstances, meshBVHs, viewBlock, visibleInstances);
+		frameCnt++;
+		buildDrawBatches(visibleInstances, instanceVBO, allInstances, batches);
+
+		ensureRenderTarget(sceneTarget, targetW, targetH);
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget.FBO);
+		glViewport(0, 0, sceneW, sceneH);
+		glEnable(GL_DEPTH_TEST);
 
-		//calculate position of light in view space
-        glm::vec4 curLightPos = viewMat * light.pos;
-        glUniform4fv(lightPosLoc, 1, glm::value_ptr(curLightPos));
-        glUniform4fv(lightColorLoc, 1, glm::value_ptr(light.color));
+		// Clear the framebuffer
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		//Draw our Models
-		renderScene(meshVector, scene->mRootNode, glm::mat4(1.0), modelMatLoc, normMatLoc, viewMat, 0);
+		//BRDF lookup table on unit 1
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, brdfLutID);
+
+		//Shadow cube maps on units 2 and 3
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, pointShadow.cubeTex[SHADOW_STATIC]);
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, pointShadow.cubeTex[SHADOW_DYNAMIC]);
+		glActiveTexture(GL_TEXTURE0);
+
+		//Only the scene's draw calls are timed: CPU work and uploads above do not depend on the resolution
+		for(int plane = 0; plane < 4; plane++) glEnable(GL_CLIP_DISTANCE0 + plane);
+		beginGPUTimer(sceneTimer);
+		renderScene(meshVector, batches, textures, materialTextures, materials, shaderVariants, frameUniforms);
+		endGPUTimer(sceneTimer);
+		for(int plane = 0; plane < 4; plane++) glDisable(GL_CLIP_DISTANCE0 + plane);
+
+		//Upscale to the main window with sharpening
+		float sharpness = min(1.0f, 1.5f * (1.0f - dynRes.scale));
+		presentViewWindow(viewWindows[0], sceneTarget, upscale, sharpness);
+
+		//The other windows read the scene target from their own contexts once this context's work is done
+		GLsync sceneDone = nullptr;
+		if(viewWindows.size() > 1) {
+			sceneDone = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+		}
 
-		// Swap buffers and poll for window events		
+		// Swap buffers
 		glfwSwapBuffers(window);
+
+		for(unsigned int w = 1; w < viewWindows.size(); w++) {
+			glfwMakeContextCurrent(viewWindows[w].window);
+			glWaitSync(sceneDone, 0, GL_TIMEOUT_IGNORED);
+			presentViewWindow(viewWindows[w], sceneTarget, upscale, sharpness);
+			glfwSwapBuffers(viewWindows[w].window);
+		}
+		if(sceneDone) {
+			glfwMakeContextCurrent(window);
+			glDeleteSync(sceneDone);
+		}
+
+		// Poll for window events
 		glfwPollEvents();
 
 		// Sleep for 15 ms
 		this_thread::sleep_for(chrono::milliseconds(15));
 	}
 
+	//Close the extra windows (their objects are shared, so the rest is cleaned up once, below)
+	for(unsigned int w = 1; w < viewWindows.size(); w++) {
+		cleanupViewWindow(viewWindows[w], window);
+	}
+	if(frameCnt > 0) {
+		cout << "Instances culled: " << (double)culledCnt / frameCnt << " per frame (" << totalViewCnt << " views)" << endl;
+	}
+
 	// Clean up mesh
 	cleanupMesh(mgl);
 
@@ -866,9 +1518,28 @@ int main(int argc, char **argv) {
 		cleanupMesh(meshVector[g]);
 	}
 
+	glDeleteBuffers(1, &instanceVBO);
+	glDeleteBuffers(1, &paletteSSBO);
+	glDeleteBuffers(1, &viewUBO);
+
+	//Clean up textures
+	printTextureStats(textures);
+	cleanupTextureStreamer(textures);
+
+	//Clean up offscreen target
+	cleanupGPUTimer(sceneTimer);
+	cleanupRenderTarget(sceneTarget);
+	glDeleteVertexArrays(1, &viewWindows[0].emptyVAO);
+
 	// Clean up shader programs
 	glUseProgram(0);
-	glDeleteProgram(programID);
+	cleanupShaderVariants(shaderVariants);
+	glDeleteTextures(1, &brdfLutID);
+	glDeleteProgram(upscale.programID);
+
+	//Clean up shadow maps
+	printShadowStats(pointShadow);
+	cleanupPointShadow(pointShadow);
 		
 	// Destroy window and stop GLFW
 	cleanupGLFW(window);
@@ -0,0 +1,121 @@
+#include <cstring>
+#include "Mesh.hpp"
+using namespace std;
+
+// Keep the four largest weights of a vertex
+static void addBoneWeight(Vertex &v, int bone, float weight) {
+	int smallest = 0;
+	for(int i = 1; i < 4; i++) {
+		if(v.boneWeights[i] < v.boneWeights[smallest]) smallest = i;
+	}
+	if(weight > v.boneWeights[smallest]) {
+		v.boneIDs[smallest] = bone;
+		v.boneWeights[smallest] = weight;
+	}
+}
+
+// Copy vertices, indices and bone weights out of an Assimp mesh
+void ExtractMeshData(aiMesh *mesh, Mesh &m) {
+	m.vertices.clear();
+	m.indices.clear();
+	m.materialIndex = mesh->mMaterialIndex;
+	for(unsigned int i = 0; i < mesh->mNumVertices; i++){
+		Vertex loopVert;
+		loopVert.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		loopVert.color = glm::vec4(1.0, 1.0, 0.0, 1.0);
+		loopVert.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		if(mesh->HasTextureCoords(0)) {
+			loopVert.texcoord = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+		}
+		m.vertices.push_back(loopVert);
+
+	}
+	for(unsigned int j = 0; j < mesh->mNumFaces; j++) {
+		aiFace face;
+		face = mesh->mFaces[j];
+		for(unsigned int k = 0; k < face.mNumIndices; k++) {
+			m.indices.push_back(face.mIndices[k]);
+		}
+
+	}
+
+	// Bone weights (renormalized in case some were dropped)
+	for(unsigned int b = 0; b < mesh->mNumBones; b++) {
+		aiBone *bone = mesh->mBones[b];
+		for(unsigned int w = 0; w < bone->mNumWeights; w++) {
+			addBoneWeight(m.vertices[bone->mWeights[w].mVertexId], b, bone->mWeights[w].mWeight);
+		}
+	}
+	if(mesh->mNumBones > 0) {
+		for(Vertex &v : m.vertices) {
+			float total = v.boneWeights.x + v.boneWeights.y + v.boneWeights.z + v.boneWeights.w;
+			if(total > 0.0f) v.boneWeights /= total;
+		}
+	}
+}
+
+// Mix a block of bytes into a hash, 8 bytes at a time
+static uint64_t hashBlock(const void *data, size_t size, uint64_t h) {
+	const unsigned char *bytes = (const unsigned char*)data;
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		h ^= word;
+		h *= 0x100000001B3ULL;
+		h ^= h >> 32;
+	}
+	for(; i < size; i++) {
+		h ^= bytes[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+// Hash of vertex, index and material content
+uint64_t hashMesh(const Mesh &m) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	size_t vertCnt = m.vertices.size();
+	size_t indexCnt = m.indices.size();
+	h = hashBlock(&vertCnt, sizeof(vertCnt), h);
+	h = hashBlock(&indexCnt, sizeof(indexCnt), h);
+	h = hashBlock(&m.materialIndex, sizeof(m.materialIndex), h);
+	h = hashBlock(m.vertices.data(), vertCnt * sizeof(Vertex), h);
+	h = hashBlock(m.indices.data(), indexCnt * sizeof(unsigned int), h);
+	return h;
+}
+
+// True if two meshes are byte-identical
+bool sameMesh(const Mesh &a, const Mesh &b) {
+	return a.materialIndex == b.materialIndex &&
+		a.vertices.size() == b.vertices.size() &&
+		a.indices.size() == b.indices.size() &&
+		memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) == 0 &&
+		memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(unsigned int)) == 0;
+}
+
+// Add a scene mesh; returns index of the unique mesh it maps to
+int addDedupMesh(MeshDedup &dedup, Mesh &m) {
+	uint64_t h = hashMesh(m);
+	vector<int> &candidates = dedup.byHash[h];
+
+	// Hash match is confirmed byte for byte
+	for(int index : candidates) {
+		if(sameMesh(dedup.uniqueMeshes[index], m)) {
+			dedup.uniqueOf.push_back(index);
+			dedup.savedBytes += meshBytes(m);
+			return index;
+		}
+	}
+
+	int index = (int)dedup.uniqueMeshes.size();
+	dedup.uniqueMeshes.push_back(move(m));
+	candidates.push_back(index);
+	dedup.uniqueOf.push_back(index);
+	return index;
+}
+
+// Size of a mesh's vertex and index data in bytes
+size_t meshBytes(const Mesh &m) {
+	return m.vertices.size() * sizeof(Vertex) + m.indices.size() * sizeof(unsigned int);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <assimp/scene.h>
+#include "glm/glm.hpp"
+
+// Struct for holding vertex data
+struct Vertex {
+	glm::vec3 position;
+	glm::vec4 color;
+	glm::vec3 normal;
+	glm::vec2 texcoord = glm::vec2(0.0f);
+	// Up to four bones per vertex (indices into the mesh's bone list)
+	glm::ivec4 boneIDs = glm::ivec4(0);
+	glm::vec4 boneWeights = glm::vec4(0.0f);
+};
+
+// Struct for holding mesh data
+struct Mesh {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	int materialIndex = -1;
+};
+
+// Struct for collapsing byte-identical meshes while loading
+struct MeshDedup {
+	// Unique meshes (what actually goes to the GPU)
+	std::vector<Mesh> uniqueMeshes;
+	// For each scene mesh, index into uniqueMeshes
+	std::vector<int> uniqueOf;
+	// Content hash -> unique meshes with that hash
+	std::unordered_map<uint64_t, std::vector<int>> byHash;
+	// Bytes of vertex/index data that did not need to be stored again
+	size_t savedBytes = 0;
+};
+
+// Copy vertices, indices and bone weights out of an Assimp mesh
+void ExtractMeshData(aiMesh *mesh, Mesh &m);
+
+// Hash of vertex, index and material content
+uint64_t hashMesh(const Mesh &m);
+
+// True if two meshes are byte-identical
+bool sameMesh(const Mesh &a, const Mesh &b);
+
+// Add a scene mesh; returns index of the unique mesh it maps to
+int addDedupMesh(MeshDedup &dedup, Mesh &m);
+
+// Size of a mesh's vertex and index data in bytes
+size_t meshBytes(const Mesh &m);
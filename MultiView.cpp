@@ -0,0 +1,104 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "MultiView.hpp"
+using namespace std;
+
+// Create a window whose context shares objects with shareWith (shareWith stays current)
+void createViewWindow(ViewWindow &vw, GLFWwindow *shareWith, int width, int height, string title) {
+	// Same context hints as the main window (set in setupGLFW)
+	vw.window = glfwCreateWindow(width, height, title.c_str(), NULL, shareWith);
+	if(!vw.window) {
+		cerr << "ERROR: Could not create window \"" << title << "\"." << endl;
+		return;
+	}
+
+	glfwMakeContextCurrent(vw.window);
+	// Only the main window waits for VSync; otherwise every extra window would add a wait
+	glfwSwapInterval(0);
+	glGenVertexArrays(1, &vw.emptyVAO);
+	glfwMakeContextCurrent(shareWith);
+}
+
+// Delete the window's vertex array and the window itself (mainWindow is made current afterwards)
+void cleanupViewWindow(ViewWindow &vw, GLFWwindow *mainWindow) {
+	if(vw.window) {
+		glfwMakeContextCurrent(vw.window);
+		glDeleteVertexArrays(1, &vw.emptyVAO);
+		glfwDestroyWindow(vw.window);
+	}
+	glfwMakeContextCurrent(mainWindow);
+	vw.window = nullptr;
+	vw.emptyVAO = 0;
+}
+
+// True once any of the windows was asked to close
+bool anyViewWindowShouldClose(vector<ViewWindow> &windows) {
+	for(ViewWindow &vw : windows) {
+		if(glfwWindowShouldClose(vw.window)) return true;
+	}
+	return false;
+}
+
+// Place the windows side by side in the scene target; returns the full-resolution size the target needs
+// and the viewport that covers every window at the current scale
+void layoutViewWindows(vector<ViewWindow> &windows, float scale, int &targetWidth, int &targetHeight,
+		int &viewportWidth, int &viewportHeight) {
+	targetWidth = 0;
+	targetHeight = 1;
+	viewportWidth = 0;
+	viewportHeight = 1;
+	for(ViewWindow &vw : windows) {
+		glfwGetFramebufferSize(vw.window, &vw.width, &vw.height);
+		vw.targetX = viewportWidth;
+		vw.targetWidth = max(1, (int)(vw.width * scale));
+		vw.targetHeight = max(1, (int)(vw.height * scale));
+		viewportWidth += vw.targetWidth;
+		viewportHeight = max(viewportHeight, vw.targetHeight);
+		targetWidth += max(1, vw.width);
+		targetHeight = max(targetHeight, vw.height);
+	}
+}
+
+// Split a window's part of the scene target into a grid, one cell per view
+void layoutViewRects(ViewWindow &vw, vector<ViewRect> &rects) {
+	int cols = (int)ceil(sqrt((double)vw.viewCnt));
+	int rows = (vw.viewCnt + cols - 1) / cols;
+	float aspect = (vw.width > 0 && vw.height > 0) ? (float)(vw.width * rows) / (vw.height * cols) : 1.0f;
+
+	rects.clear();
+	for(int i = 0; i < vw.viewCnt; i++) {
+		int col = i % cols;
+		int row = i / cols;
+		// First row at the top
+		int x0 = vw.targetWidth * col / cols;
+		int x1 = vw.targetWidth * (col + 1) / cols;
+		int y0 = vw.targetHeight * (rows - row - 1) / rows;
+		int y1 = vw.targetHeight * (rows - row) / rows;
+
+		ViewRect rect;
+		rect.x = vw.targetX + x0;
+		rect.y = y0;
+		rect.width = max(1, x1 - x0);
+		rect.height = max(1, y1 - y0);
+		rect.aspect = aspect;
+		rects.push_back(rect);
+	}
+}
+
+// Scale and offset that move a view's clip space into its rectangle of the viewport
+glm::vec4 makeClipRect(ViewRect &rect, int viewportWidth, int viewportHeight) {
+	float sx = (float)rect.width / viewportWidth;
+	float sy = (float)rect.height / viewportHeight;
+	float cx = (rect.x + 0.5f * rect.width) / viewportWidth * 2.0f - 1.0f;
+	float cy = (rect.y + 0.5f * rect.height) / viewportHeight * 2.0f - 1.0f;
+	return glm::vec4(sx, sy, cx, cy);
+}
+
+// Upload the views and bind the buffer to uniform binding 0
+void uploadViewBlock(ViewBlock &vb, GLuint viewUBO) {
+	glBindBuffer(GL_UNIFORM_BUFFER, viewUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewBlock), &vb, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, viewUBO);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "glm/glm.hpp"
+
+// Most views drawn in one pass (MAX_VIEWS in Basic.vs)
+const int MAX_VIEWS = 8;
+
+// Camera of one view (std140 layout of ViewData in Basic.vs)
+struct ViewUniforms {
+	glm::mat4 viewMat;
+	glm::mat4 projMat;
+	// Light position in view space
+	glm::vec4 lightPos;
+	// Scale (xy) and offset (zw) from the view's clip space to its part of the target
+	glm::vec4 clipRect;
+};
+
+// Contents of the view uniform buffer (ViewBlock in Basic.vs, binding 0)
+struct ViewBlock {
+	ViewUniforms views[MAX_VIEWS];
+	int viewCnt = 0;
+	int pad[3] = { 0, 0, 0 };
+};
+
+// Pixel rectangle of one view in the scene target
+struct ViewRect {
+	int x = 0;
+	int y = 0;
+	int width = 1;
+	int height = 1;
+	// Aspect ratio at full resolution
+	float aspect = 1.0f;
+};
+
+// Struct for holding a window and the views shown in it
+// Extra windows share buffers, programs and textures with the main window
+struct ViewWindow {
+	GLFWwindow *window = nullptr;
+	// Vertex arrays are not shared between contexts, so each window has its own for the fullscreen triangle
+	GLuint emptyVAO = 0;
+	int viewCnt = 1;
+	// Index of the window's first view
+	int firstView = 0;
+	// Framebuffer size
+	int width = 0;
+	int height = 0;
+	// Part of the scene target the window's views are rendered into (at the current resolution scale)
+	int targetX = 0;
+	int targetWidth = 1;
+	int targetHeight = 1;
+};
+
+// Create a window whose context shares objects with shareWith (shareWith stays current)
+void createViewWindow(ViewWindow &vw, GLFWwindow *shareWith, int width, int height, std::string title);
+
+// Delete the window's vertex array and the window itself (mainWindow is made current afterwards)
+void cleanupViewWindow(ViewWindow &vw, GLFWwindow *mainWindow);
+
+// True once any of the windows was asked to close
+bool anyViewWindowShouldClose(std::vector<ViewWindow> &windows);
+
+// Place the windows side by side in the scene target; returns the full-resolution size the target needs
+// and the viewport that covers every window at the current scale
+void layoutViewWindows(std::vector<ViewWindow> &windows, float scale, int &targetWidth, int &targetHeight,
+	int &viewportWidth, int &viewportHeight);
+
+// Split a window's part of the scene target into a grid, one cell per view
+void layoutViewRects(ViewWindow &vw, std::vector<ViewRect> &rects);
+
+// Scale and offset that move a view's clip space into its rectangle of the viewport
+glm::vec4 makeClipRect(ViewRect &rect, int viewportWidth, int viewportHeight);
+
+// Upload the views and bind the buffer to uniform binding 0
+void uploadViewBlock(ViewBlock &vb, GLuint viewUBO);
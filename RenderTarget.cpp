@@ -0,0 +1,124 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "RenderTarget.hpp"
+using namespace std;
+
+// Make sure render target is allocated at exactly this size (reallocated whenever the size changes)
+void ensureRenderTarget(RenderTarget &rt, int width, int height) {
+	width = max(1, width);
+	height = max(1, height);
+	if(rt.FBO && rt.allocWidth == width && rt.allocHeight == height) return;
+	cleanupRenderTarget(rt);
+
+	rt.allocWidth = width;
+	rt.allocHeight = height;
+
+	// Color (linear filtering for the upscale)
+	glGenTextures(1, &rt.colorTex);
+	glBindTexture(GL_TEXTURE_2D, rt.colorTex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, rt.allocWidth, rt.allocHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Depth
+	glGenRenderbuffers(1, &rt.depthRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, rt.depthRB);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, rt.allocWidth, rt.allocHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// Framebuffer
+	glGenFramebuffers(1, &rt.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, rt.FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rt.colorTex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rt.depthRB);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "ERROR: Offscreen render target is incomplete." << endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Delete render target
+void cleanupRenderTarget(RenderTarget &rt) {
+	if(rt.FBO) glDeleteFramebuffers(1, &rt.FBO);
+	if(rt.colorTex) glDeleteTextures(1, &rt.colorTex);
+	if(rt.depthRB) glDeleteRenderbuffers(1, &rt.depthRB);
+	rt.FBO = 0;
+	rt.colorTex = 0;
+	rt.depthRB = 0;
+	rt.allocWidth = 0;
+	rt.allocHeight = 0;
+}
+
+// Create timer queries
+void createGPUTimer(GPUTimer &timer) {
+	glGenQueries(GPUTimer::QUERY_CNT, timer.queries);
+	timer.next = 0;
+	timer.inFlight = 0;
+}
+
+// Delete timer queries
+void cleanupGPUTimer(GPUTimer &timer) {
+	glDeleteQueries(GPUTimer::QUERY_CNT, timer.queries);
+	timer.inFlight = 0;
+}
+
+// Start timing GPU work (skipped if every query is still in flight)
+void beginGPUTimer(GPUTimer &timer) {
+	if(timer.inFlight == GPUTimer::QUERY_CNT) return;
+	glBeginQuery(GL_TIME_ELAPSED, timer.queries[timer.next]);
+}
+
+// Stop timing GPU work
+void endGPUTimer(GPUTimer &timer) {
+	if(timer.inFlight == GPUTimer::QUERY_CNT) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	timer.next = (timer.next + 1) % GPUTimer::QUERY_CNT;
+	timer.inFlight++;
+}
+
+// Collect finished measurements; returns true if lastMs was updated
+bool readGPUTimer(GPUTimer &timer) {
+	bool updated = false;
+	while(timer.inFlight > 0) {
+		int oldest = (timer.next - timer.inFlight + GPUTimer::QUERY_CNT) % GPUTimer::QUERY_CNT;
+		GLint available = 0;
+		glGetQueryObjectiv(timer.queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) break;
+
+		GLuint64 elapsedNs = 0;
+		glGetQueryObjectui64v(timer.queries[oldest], GL_QUERY_RESULT, &elapsedNs);
+		timer.lastMs = elapsedNs / 1.0e6;
+		timer.inFlight--;
+		updated = true;
+	}
+	return updated;
+}
+
+// Adjust resolution scale from a GPU time measurement
+void updateDynamicResolution(DynamicResolution &dr, double gpuMs) {
+	if(dr.budgetMs <= 0.0f) {
+		dr.scale = dr.maxScale;
+		return;
+	}
+
+	// Smooth out single-frame spikes
+	if(dr.smoothedMs <= 0.0f) dr.smoothedMs = (float)gpuMs;
+	dr.smoothedMs = 0.8f * dr.smoothedMs + 0.2f * (float)gpuMs;
+	if(dr.smoothedMs <= 0.0f) return;
+
+	// Fragment cost goes with pixel count (scale squared)
+	float ideal = dr.scale * sqrt(dr.budgetMs / dr.smoothedMs);
+
+	// Drop quickly when over budget; climb slowly and only with some headroom
+	if(dr.smoothedMs > dr.budgetMs) {
+		dr.scale = 0.5f * dr.scale + 0.5f * ideal;
+	}
+	else if(dr.smoothedMs < 0.85f * dr.budgetMs) {
+		dr.scale = 0.9f * dr.scale + 0.1f * ideal;
+	}
+	dr.scale = min(dr.maxScale, max(dr.minScale, dr.scale));
+}
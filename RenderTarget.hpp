@@ -0,0 +1,55 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Struct for holding an offscreen render target (color texture + depth)
+// Allocated at the full-resolution size of all windows' views side by side (see layoutViewWindows);
+// lower resolutions render into the lower-left part of it
+struct RenderTarget {
+	GLuint FBO = 0;
+	GLuint colorTex = 0;
+	GLuint depthRB = 0;
+	int allocWidth = 0;
+	int allocHeight = 0;
+};
+
+// Struct for holding a ring of GPU timer queries (read back without stalling)
+struct GPUTimer {
+	static const int QUERY_CNT = 4;
+	GLuint queries[QUERY_CNT] = { 0 };
+	int next = 0;
+	int inFlight = 0;
+	double lastMs = 0.0;
+};
+
+// Struct for holding dynamic resolution settings and state
+struct DynamicResolution {
+	// GPU time budget for the scene pass (0 = always full resolution)
+	float budgetMs = 12.0f;
+	float minScale = 0.25f;
+	float maxScale = 1.0f;
+	// Current resolution scale (per axis)
+	float scale = 1.0f;
+	// Smoothed measured GPU time
+	float smoothedMs = 0.0f;
+};
+
+// Make sure render target is allocated at exactly this size (reallocated whenever the size changes)
+void ensureRenderTarget(RenderTarget &rt, int width, int height);
+
+// Delete render target
+void cleanupRenderTarget(RenderTarget &rt);
+
+// Create and delete timer queries
+void createGPUTimer(GPUTimer &timer);
+void cleanupGPUTimer(GPUTimer &timer);
+
+// Start/stop timing GPU work; at most QUERY_CNT measurements may be in flight
+void beginGPUTimer(GPUTimer &timer);
+void endGPUTimer(GPUTimer &timer);
+
+// Collect finished measurements; returns true if lastMs was updated
+bool readGPUTimer(GPUTimer &timer);
+
+// Adjust resolution scale from a GPU time measurement
+void updateDynamicResolution(DynamicResolution &dr, double gpuMs);
@@ -0,0 +1,306 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <iomanip>
+#include "Shader.hpp"
+using namespace std;
+
+// Read from file and dump in string
+string readFileToString(string filename) {
+	// Open file
+	ifstream file(filename);
+	// Could we open file?
+	if(!file || file.fail()) {
+		cerr << "ERROR: Could not open file: " << filename << endl;
+		const char *m = ("ERROR: Could not open file: " + filename).c_str();
+		throw runtime_error(m);
+	}
+
+	// Create output stream to receive file data
+	ostringstream outS;
+	outS << file.rdbuf();
+	// Get actual string of file contents
+	string allS = outS.str();
+	// Close file
+	file.close();
+	// Return string
+	return allS;
+}
+
+// Print out shader code
+void printShaderCode(string &vertexCode, string &fragCode) {
+	cout << "***********************" << endl;
+	cout <<"** VERTEX SHADER CODE **" << endl;
+	cout << "***********************" << endl;
+	cout << vertexCode << endl;
+	cout << "*************************" << endl;
+	cout <<"** FRAGMENT SHADER CODE **" << endl;
+	cout << "*************************" << endl;
+	cout << fragCode << endl;
+	cout << "*************************" << endl;
+}
+
+// GLSL Compiling/Linking Error Check
+// Returns GL_TRUE if compile was successful; GL_FALSE otherwise.
+GLint checkGLSLError(GLuint ID, bool isCompile) {
+
+	GLint resultGL = GL_FALSE;
+	int infoLogLength;
+	char *errorMessage = nullptr;
+
+	if(isCompile) {
+		// Get the compilation status and message length
+		glGetShaderiv(ID, GL_COMPILE_STATUS, &resultGL);	
+		glGetShaderiv(ID, GL_INFO_LOG_LENGTH, &infoLogLength);
+	}
+	else {
+		// Get linking status and message length
+		glGetProgramiv(ID, GL_LINK_STATUS, &resultGL);
+		glGetProgramiv(ID, GL_INFO_LOG_LENGTH, &infoLogLength);
+	}
+
+	// Make sure length is at least one and allocate space for message	
+	infoLogLength = (infoLogLength > 1) ? infoLogLength : 1;
+	errorMessage = new char[infoLogLength];	
+
+	// Get actual message
+	if(isCompile)
+		glGetShaderInfoLog(ID, infoLogLength, NULL, errorMessage);		
+	else	
+		glGetProgramInfoLog(ID, infoLogLength, NULL, errorMessage);
+
+	// Print error message
+	if(infoLogLength > 1)
+		cout << errorMessage << endl;
+
+	// Cleanup
+	if(errorMessage) delete [] errorMessage;
+
+	// Return OpenGL error
+	return resultGL;
+}
+
+// Creates and compiles GLSL shader from code string; returns shader ID
+GLuint createAndCompileShader(const char *shaderCode, GLenum shaderType) {
+	// Create the shader ID
+	GLuint shaderID = glCreateShader(shaderType);
+
+	// Compile the vertex shader...
+	cout << "Compiling shader..." << endl;
+	glShaderSource(shaderID, 1, &shaderCode, NULL);
+	glCompileShader(shaderID);
+
+	// Checking result of compilation...
+	GLint compileOK = checkGLSLError(shaderID, true);
+	if (!compileOK || shaderID == 0) {
+		glDeleteShader(shaderID);		
+		cout << "Error compiling shader." << endl;
+		throw runtime_error("Error compiling shader.");
+	}
+
+	// Return shader ID
+	return shaderID;
+}
+
+// Given a list of compiled shaders, create and link a shader program (ID returned).
+GLuint createAndLinkShaderProgram(std::vector<GLuint> allShaderIDs) {
+
+	// Create program ID and attach shaders
+	cout << "Linking program..." << endl;
+	GLuint programID = glCreateProgram();
+	for (GLuint &shaderID : allShaderIDs) {
+		glAttachShader(programID, shaderID);
+	}
+
+	// Actually link the program
+	glLinkProgram(programID);
+
+	// Detach shaders (program already linked, successful or not)
+	for (GLuint &shaderID : allShaderIDs) {
+		glDetachShader(programID, shaderID);		
+	}
+
+	// Check linking
+	GLint linkOK = checkGLSLError(programID, false);
+	if (!linkOK || programID == 0) {		
+		glDeleteProgram(programID);		
+		cout << "Error linking shaders." << endl;
+		throw runtime_error("Error linking shaders.");
+	}
+
+	// Return program ID
+	return programID;
+}
+
+// Does the following:
+// - Creates and compiles vertex, geometry (if geometryShaderCode is not empty), and fragment shaders
+// - Creates and links shader program
+// - Deletes the individual shaders
+static GLuint buildShaderProgram(const string &vertexShaderCode, const string &geometryShaderCode,
+		const string &fragmentShaderCode) {
+	GLuint vertID = 0;
+	GLuint geomID = 0;
+	GLuint fragID = 0;
+	GLuint programID = 0;
+
+	try {
+		// Create and compile shaders
+		cout << "Vertex shader: ";
+		vertID = createAndCompileShader(vertexShaderCode.c_str(), GL_VERTEX_SHADER);
+		if(!geometryShaderCode.empty()) {
+			cout << "Geometry shader: ";
+			geomID = createAndCompileShader(geometryShaderCode.c_str(), GL_GEOMETRY_SHADER);
+		}
+		cout << "Fragment shader: ";
+		fragID = createAndCompileShader(fragmentShaderCode.c_str(), GL_FRAGMENT_SHADER);
+
+		// Create and link program
+		vector<GLuint> allShaderIDs = { vertID, fragID };
+		if(geomID) allShaderIDs.insert(allShaderIDs.begin() + 1, geomID);
+		programID = createAndLinkShaderProgram(allShaderIDs);
+
+		// Delete individual shaders
+		glDeleteShader(vertID);
+		if(geomID) glDeleteShader(geomID);
+		glDeleteShader(fragID);
+
+		// Success!
+		cout << "Program successfully compiled and linked!" << endl;
+	}
+	catch (exception &e) {
+		// Cleanup shaders and shader program, just in case
+		if (vertID) glDeleteShader(vertID);
+		if (geomID) glDeleteShader(geomID);
+		if (fragID) glDeleteShader(fragID);
+		// Rethrow exception
+		throw;
+	}
+
+	return programID;
+}
+
+// Creates, compiles, and links a shader program from vertex and fragment code
+GLuint initShaderProgramFromSource(string vertexShaderCode, string fragmentShaderCode) {
+	return buildShaderProgram(vertexShaderCode, "", fragmentShaderCode);
+}
+
+// Same, with a geometry shader between the vertex and fragment shaders
+GLuint initShaderProgramFromSource(string vertexShaderCode, string geometryShaderCode, string fragmentShaderCode) {
+	return buildShaderProgram(vertexShaderCode, geometryShaderCode, fragmentShaderCode);
+}
+
+// Insert preprocessor defines right after the #version line
+string addShaderDefines(const string &code, const string &defines) {
+	if(defines.empty()) return code;
+	size_t versionPos = code.find("#version");
+	if(versionPos == string::npos) return defines + code;
+	size_t lineEnd = code.find('\n', versionPos);
+	if(lineEnd == string::npos) return code + "\n" + defines;
+	return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+}
+
+// Define block for a set of flags (fixed material values are baked in as constants)
+string makeVariantDefines(unsigned int flags, float metallic, float roughness) {
+	ostringstream defines;
+	if(flags & VARIANT_TEXTURED) defines << "#define TEXTURED\n";
+	if(flags & VARIANT_UNLIT) defines << "#define UNLIT\n";
+	if(flags & VARIANT_DIELECTRIC) defines << "#define DIELECTRIC\n";
+	if(flags & VARIANT_METAL) defines << "#define METAL\n";
+	if(flags & VARIANT_BRDF_LUT) defines << "#define USE_BRDF_LUT\n";
+	if(flags & VARIANT_DEBUG_NORMALS) defines << "#define DEBUG_NORMALS\n";
+	if(flags & VARIANT_DEBUG_ALBEDO) defines << "#define DEBUG_ALBEDO\n";
+	if(flags & VARIANT_DEBUG_SPECULAR) defines << "#define DEBUG_SPECULAR\n";
+	if(flags & VARIANT_FIXED_MATERIAL) {
+		// Material values from the file, rounded like every material value
+		defines << fixed << setprecision(2);
+		defines << "#define FIXED_MATERIAL\n";
+		defines << "#define FIXED_METALLIC " << metallic << "\n";
+		defines << "#define FIXED_ROUGHNESS " << roughness << "\n";
+	}
+	return defines.str();
+}
+
+// Get (compiling on first use) the variant for a set of flags
+ShaderVariant &getShaderVariant(ShaderVariantCache &cache, unsigned int flags, float metallic, float roughness) {
+	string defines = makeVariantDefines(flags, metallic, roughness);
+	auto found = cache.variants.find(defines);
+	if(found != cache.variants.end()) return found->second;
+
+	cout << "Building shader variant:" << endl << defines;
+	ShaderVariant variant;
+	variant.programID = initShaderProgramFromSource(addShaderDefines(cache.vertexCode, defines),
+		addShaderDefines(cache.fragCode, defines));
+	variant.lightColorLoc = glGetUniformLocation(variant.programID, "light.color");
+	variant.metalLoc = glGetUniformLocation(variant.programID, "metallic");
+	variant.roughLoc = glGetUniformLocation(variant.programID, "roughness");
+	variant.diffuseTexLoc = glGetUniformLocation(variant.programID, "diffuseTex");
+	variant.brdfLutLoc = glGetUniformLocation(variant.programID, "brdfLut");
+	variant.shadowStaticLoc = glGetUniformLocation(variant.programID, "shadowStatic");
+	variant.shadowDynamicLoc = glGetUniformLocation(variant.programID, "shadowDynamic");
+	variant.shadowLightPosLoc = glGetUniformLocation(variant.programID, "shadowLightPos");
+	variant.shadowFarLoc = glGetUniformLocation(variant.programID, "shadowFar");
+	return cache.variants[defines] = variant;
+}
+
+// Get the variant for a set of flags if it is built; otherwise queue it and return nullptr (never compiles)
+ShaderVariant *findShaderVariant(ShaderVariantCache &cache, unsigned int flags, float metallic, float roughness) {
+	string defines = makeVariantDefines(flags, metallic, roughness);
+	auto found = cache.variants.find(defines);
+	if(found != cache.variants.end()) return &found->second;
+
+	ShaderVariantRequest request;
+	request.flags = flags;
+	request.metallic = metallic;
+	request.roughness = roughness;
+	cache.pending[defines] = request;
+	return nullptr;
+}
+
+// Build queued variants; one that fails to build is reported and not tried again
+void buildPendingShaderVariants(ShaderVariantCache &cache) {
+	for(auto &entry : cache.pending) {
+		ShaderVariantRequest &request = entry.second;
+		try {
+			getShaderVariant(cache, request.flags, request.metallic, request.roughness);
+		}
+		catch (exception &e) {
+			cerr << "ERROR: Could not build shader variant:" << endl << entry.first;
+			cache.variants[entry.first] = ShaderVariant();
+		}
+	}
+	cache.pending.clear();
+}
+
+// Delete all variant programs
+void cleanupShaderVariants(ShaderVariantCache &cache) {
+	for(auto &entry : cache.variants) {
+		glDeleteProgram(entry.second.programID);
+	}
+	cache.variants.clear();
+}
+
+// Create the BRDF lookup texture (x = cosine, y = roughness; r = Schlick geometry term)
+GLuint createBRDFLut(int size) {
+	vector<float> data((size_t)size * size);
+	for(int y = 0; y < size; y++) {
+		float roughness = (float)y / (size - 1);
+		float k = (roughness + 1.0f) * (roughness + 1.0f) / 8.0f;
+		for(int x = 0; x < size; x++) {
+			float cosAngle = (float)x / (size - 1);
+			data[(size_t)y*size + x] = cosAngle / (cosAngle * (1.0f - k) + k);
+		}
+	}
+
+	GLuint lutID = 0;
+	glGenTextures(1, &lutID);
+	glBindTexture(GL_TEXTURE_2D, lutID);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, size, size);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT, data.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return lutID;
+}
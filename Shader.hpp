@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <GL/glew.h>
+
+// Read from file and dump in string
+std::string readFileToString(std::string filename);
+
+// Print out shader code
+void printShaderCode(std::string &vertexCode, std::string &fragCode);
+
+// GLSL Compiling/Linking Error Check
+GLint checkGLSLError(GLuint ID, bool isCompile);
+
+// Creates and compiles GLSL shader from code string; returns shader ID
+GLuint createAndCompileShader(const char *shaderCode, GLenum shaderType);
+
+// Given a list of compiled shaders, create and link a shader program (ID returned).
+GLuint createAndLinkShaderProgram(std::vector<GLuint> allShaderIDs);
+
+// Creates, compiles, and links a shader program from vertex and fragment code
+GLuint initShaderProgramFromSource(std::string vertexShaderCode, std::string fragmentShaderCode);
+
+// Same, with a geometry shader between the vertex and fragment shaders
+GLuint initShaderProgramFromSource(std::string vertexShaderCode, std::string geometryShaderCode, std::string fragmentShaderCode);
+
+// Insert preprocessor defines right after the #version line
+std::string addShaderDefines(const std::string &code, const std::string &defines);
+
+// Features a shader variant can be specialized for
+enum ShaderVariantFlags {
+	VARIANT_TEXTURED = 1 << 0,
+	VARIANT_UNLIT = 1 << 1,
+	VARIANT_DIELECTRIC = 1 << 2,
+	VARIANT_METAL = 1 << 3,
+	VARIANT_FIXED_MATERIAL = 1 << 4,
+	VARIANT_BRDF_LUT = 1 << 5,
+	VARIANT_DEBUG_NORMALS = 1 << 6,
+	VARIANT_DEBUG_ALBEDO = 1 << 7,
+	VARIANT_DEBUG_SPECULAR = 1 << 8
+};
+
+// Struct for holding one compiled variant and its uniform locations
+// (cameras and the light position come from the view uniform buffer)
+struct ShaderVariant {
+	GLuint programID = 0;
+	GLint lightColorLoc = -1;
+	GLint metalLoc = -1;
+	GLint roughLoc = -1;
+	GLint diffuseTexLoc = -1;
+	GLint brdfLutLoc = -1;
+	GLint shadowStaticLoc = -1;
+	GLint shadowDynamicLoc = -1;
+	GLint shadowLightPosLoc = -1;
+	GLint shadowFarLoc = -1;
+	// Frame in which the per-frame uniforms were last set
+	long long frameSet = -1;
+};
+
+// Struct for holding a variant that was asked for but not built yet
+struct ShaderVariantRequest {
+	unsigned int flags = 0;
+	float metallic = 0.0f;
+	float roughness = 0.0f;
+};
+
+// Struct for holding all variants built from one vertex/fragment source pair
+struct ShaderVariantCache {
+	std::string vertexCode;
+	std::string fragCode;
+	// Keyed by the define block used to build the variant (programID 0 if it failed to build)
+	std::unordered_map<std::string, ShaderVariant> variants;
+	// Variants to build in buildPendingShaderVariants (same keys)
+	std::unordered_map<std::string, ShaderVariantRequest> pending;
+};
+
+// Define block for a set of flags (fixed material values are baked in as constants)
+std::string makeVariantDefines(unsigned int flags, float metallic, float roughness);
+
+// Get (compiling on first use) the variant for a set of flags
+ShaderVariant &getShaderVariant(ShaderVariantCache &cache, unsigned int flags, float metallic, float roughness);
+
+// Get the variant for a set of flags if it is built; otherwise queue it and return nullptr (never compiles)
+ShaderVariant *findShaderVariant(ShaderVariantCache &cache, unsigned int flags, float metallic, float roughness);
+
+// Build queued variants; one that fails to build is reported and not tried again
+void buildPendingShaderVariants(ShaderVariantCache &cache);
+
+// Delete all variant programs
+void cleanupShaderVariants(ShaderVariantCache &cache);
+
+// Create the BRDF lookup texture (x = cosine, y = roughness; r = Schlick geometry term)
+GLuint createBRDFLut(int size);
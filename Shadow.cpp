@@ -0,0 +1,212 @@
+#include <iostream>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "Shadow.hpp"
+using namespace std;
+
+// Create cube maps and framebuffer (programID is the linked Shadow.vs/.gs/.fs program)
+void createPointShadow(PointShadow &ps, int size, float farPlane, GLuint programID) {
+	ps.size = size;
+	ps.farPlane = farPlane;
+
+	// Depth cube maps, read back as plain values (compare mode off)
+	for(int layer = 0; layer < SHADOW_LAYER_CNT; layer++) {
+		glGenTextures(1, &ps.cubeTex[layer]);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, ps.cubeTex[layer]);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_DEPTH_COMPONENT32F, size, size);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	// Depth-only framebuffer; all six faces are attached as layers
+	glGenFramebuffers(1, &ps.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, ps.FBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ps.cubeTex[SHADOW_STATIC], 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		cerr << "ERROR: Shadow framebuffer is incomplete." << endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	ps.programID = programID;
+	ps.faceMatsLoc = glGetUniformLocation(programID, "faceMats");
+	ps.faceMaskLoc = glGetUniformLocation(programID, "faceMask");
+	ps.lightPosLoc = glGetUniformLocation(programID, "lightPos");
+	ps.farPlaneLoc = glGetUniformLocation(programID, "farPlane");
+
+	ps.dirtyFaces[SHADOW_STATIC] = SHADOW_ALL_FACES;
+	ps.dirtyFaces[SHADOW_DYNAMIC] = SHADOW_ALL_FACES;
+}
+
+// Delete textures, framebuffer and program
+void cleanupPointShadow(PointShadow &ps) {
+	glDeleteTextures(SHADOW_LAYER_CNT, ps.cubeTex);
+	glDeleteFramebuffers(1, &ps.FBO);
+	glDeleteProgram(ps.programID);
+	for(int layer = 0; layer < SHADOW_LAYER_CNT; layer++) ps.cubeTex[layer] = 0;
+	ps.FBO = 0;
+	ps.programID = 0;
+	ps.casters.clear();
+}
+
+// Faces of a cube map around lightPos whose frustum may contain a box (conservative)
+unsigned int shadowFacesForBounds(glm::vec3 lightPos, glm::vec3 bmin, glm::vec3 bmax) {
+	glm::vec3 lo = bmin - lightPos;
+	glm::vec3 hi = bmax - lightPos;
+
+	// Face (2*axis + side) sees points whose coordinate along the axis is at least the other two (absolute)
+	unsigned int mask = 0;
+	for(int axis = 0; axis < 3; axis++) {
+		for(int side = 0; side < 2; side++) {
+			float along = (side == 0) ? hi[axis] : -lo[axis];
+			if(along < 0.0f) continue;
+
+			bool inside = true;
+			for(int other = 0; other < 3; other++) {
+				if(other == axis) continue;
+				float closest = (lo[other] <= 0.0f && hi[other] >= 0.0f) ? 0.0f : min(fabs(lo[other]), fabs(hi[other]));
+				if(closest > along) inside = false;
+			}
+			if(inside) mask |= 1u << (2 * axis + side);
+		}
+	}
+	return mask;
+}
+
+// Compare this frame's casters with the last frame and mark the faces that must be re-rendered
+// (skinnedMoved: the animation clock stepped or the clip restarted, so every skinned caster counts as moving)
+void updatePointShadow(PointShadow &ps, glm::vec3 lightPos, vector<ShadowCaster> &frameCasters, bool skinnedMoved) {
+	ps.frameCnt++;
+
+	// Light moved: every face of both layers is stale
+	if(!ps.lightValid || glm::distance(lightPos, ps.lightPos) > 1e-5f) {
+		ps.lightPos = lightPos;
+		ps.lightValid = true;
+		ps.dirtyFaces[SHADOW_STATIC] = SHADOW_ALL_FACES;
+		ps.dirtyFaces[SHADOW_DYNAMIC] = SHADOW_ALL_FACES;
+	}
+
+	// Casters are matched by position in the list; a different count means a different scene
+	bool tracked = (frameCasters.size() == ps.casters.size());
+	if(!tracked) {
+		ps.dirtyFaces[SHADOW_STATIC] = SHADOW_ALL_FACES;
+		ps.dirtyFaces[SHADOW_DYNAMIC] = SHADOW_ALL_FACES;
+	}
+
+	for(unsigned int i = 0; i < frameCasters.size(); i++) {
+		ShadowCaster &c = frameCasters[i];
+
+		// Faces touched now (skinned casters can deform anywhere, so all of them)
+		unsigned int mask = SHADOW_ALL_FACES;
+		if(c.boneOffset < 0) {
+			glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+			for(int corner = 0; corner < 8; corner++) {
+				glm::vec4 p((corner & 1) ? c.localMax.x : c.localMin.x,
+					(corner & 2) ? c.localMax.y : c.localMin.y,
+					(corner & 4) ? c.localMax.z : c.localMin.z, 1.0f);
+				glm::vec3 world = glm::vec3(c.modelMat * p);
+				bmin = glm::min(bmin, world);
+				bmax = glm::max(bmax, world);
+			}
+			mask = shadowFacesForBounds(ps.lightPos, bmin, bmax);
+		}
+
+		if(!tracked) {
+			c.layer = SHADOW_STATIC;
+			c.stillFrames = 0;
+			c.faceMask = mask;
+			continue;
+		}
+
+		ShadowCaster &prev = ps.casters[i];
+		c.layer = prev.layer;
+		c.stillFrames = prev.stillFrames;
+		bool moved = (c.modelMat != prev.modelMat) || (c.meshIndex != prev.meshIndex)
+			|| (c.boneOffset >= 0 && skinnedMoved);
+		if(moved) {
+			// Remove it from where it was drawn, draw it again (in the moving layer) where it is now
+			ps.dirtyFaces[prev.layer] |= prev.faceMask;
+			ps.dirtyFaces[SHADOW_DYNAMIC] |= mask;
+			c.layer = SHADOW_DYNAMIC;
+			c.stillFrames = 0;
+		}
+		else {
+			c.stillFrames++;
+			if(c.layer == SHADOW_DYNAMIC && c.stillFrames >= ps.stillFramesToStatic) {
+				// Settled: move it into the cached layer
+				ps.dirtyFaces[SHADOW_DYNAMIC] |= prev.faceMask;
+				ps.dirtyFaces[SHADOW_STATIC] |= mask;
+				c.layer = SHADOW_STATIC;
+			}
+		}
+		c.faceMask = mask;
+	}
+	ps.casters.swap(frameCasters);
+}
+
+// Bind framebuffer and program for one layer and clear its dirty faces (false if nothing to draw)
+bool beginShadowLayer(PointShadow &ps, ShadowLayer layer) {
+	unsigned int dirty = ps.dirtyFaces[layer];
+	if(!dirty) return false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, ps.FBO);
+	glViewport(0, 0, ps.size, ps.size);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+
+	// Clear only the dirty faces
+	for(int face = 0; face < 6; face++) {
+		if(!(dirty & (1u << face))) continue;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+			ps.cubeTex[layer], 0);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		ps.faceRenderCnt++;
+	}
+
+	// All faces as layers; the geometry shader only emits to the dirty ones
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ps.cubeTex[layer], 0);
+
+	// Standard cube map face orientations
+	glm::vec3 dirs[6] = { glm::vec3(1,0,0), glm::vec3(-1,0,0), glm::vec3(0,1,0),
+		glm::vec3(0,-1,0), glm::vec3(0,0,1), glm::vec3(0,0,-1) };
+	glm::vec3 ups[6] = { glm::vec3(0,-1,0), glm::vec3(0,-1,0), glm::vec3(0,0,1),
+		glm::vec3(0,0,-1), glm::vec3(0,-1,0), glm::vec3(0,-1,0) };
+	glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, ps.nearPlane, ps.farPlane);
+	glm::mat4 faceMats[6];
+	for(int face = 0; face < 6; face++) {
+		faceMats[face] = proj * glm::lookAt(ps.lightPos, ps.lightPos + dirs[face], ups[face]);
+	}
+
+	glUseProgram(ps.programID);
+	glUniformMatrix4fv(ps.faceMatsLoc, 6, false, glm::value_ptr(faceMats[0]));
+	glUniform1i(ps.faceMaskLoc, (int)dirty);
+	glUniform3fv(ps.lightPosLoc, 1, glm::value_ptr(ps.lightPos));
+	glUniform1f(ps.farPlaneLoc, ps.farPlane);
+	return true;
+}
+
+// Mark all faces clean after drawing and unbind the framebuffer
+void endPointShadow(PointShadow &ps) {
+	ps.dirtyFaces[SHADOW_STATIC] = 0;
+	ps.dirtyFaces[SHADOW_DYNAMIC] = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Print how many faces were re-rendered
+void printShadowStats(PointShadow &ps) {
+	cout << "Shadow faces re-rendered: " << ps.faceRenderCnt << " in " << ps.frameCnt << " frames";
+	if(ps.frameCnt > 0) {
+		cout << " (" << (double)ps.faceRenderCnt / ps.frameCnt << " per frame; 6 without caching)";
+	}
+	cout << endl;
+}
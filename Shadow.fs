@@ -0,0 +1,12 @@
+#version 430 core
+
+in vec3 worldPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+void main()
+{
+	// Store distance to the light (works the same for every face)
+	gl_FragDepth = length(worldPos - lightPos) / farPlane;
+}
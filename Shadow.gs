@@ -0,0 +1,38 @@
+#version 430 core
+
+// One invocation per cube face: all six faces in a single pass
+layout(triangles, invocations = 6) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+// View-projection of each face (+X, -X, +Y, -Y, +Z, -Z)
+uniform mat4 faceMats[6];
+
+// Faces being re-rendered (one bit per face)
+uniform int faceMask;
+
+out vec3 worldPos;
+
+void main()
+{
+	int face = gl_InvocationID;
+	if((faceMask & (1 << face)) == 0) return;
+
+	vec4 clipPos[3];
+	for(int i = 0; i < 3; i++) {
+		clipPos[i] = faceMats[face] * gl_in[i].gl_Position;
+	}
+
+	// Skip triangles entirely outside this face's frustum
+	for(int axis = 0; axis < 3; axis++) {
+		if(clipPos[0][axis] > clipPos[0].w && clipPos[1][axis] > clipPos[1].w && clipPos[2][axis] > clipPos[2].w) return;
+		if(clipPos[0][axis] < -clipPos[0].w && clipPos[1][axis] < -clipPos[1].w && clipPos[2][axis] < -clipPos[2].w) return;
+	}
+
+	for(int i = 0; i < 3; i++) {
+		gl_Layer = face;
+		gl_Position = clipPos[i];
+		worldPos = vec3(gl_in[i].gl_Position);
+		EmitVertex();
+	}
+	EndPrimitive();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+// Shadow map layers: casters that have not moved lately, and the moving ones
+enum ShadowLayer {
+	SHADOW_STATIC = 0,
+	SHADOW_DYNAMIC = 1,
+	SHADOW_LAYER_CNT = 2
+};
+
+// All six cube faces (+X, -X, +Y, -Y, +Z, -Z; one bit each)
+const unsigned int SHADOW_ALL_FACES = 0x3F;
+
+// One shadow caster (instance); gathered in the same order every frame
+struct ShadowCaster {
+	int meshIndex = 0;
+	glm::mat4 modelMat;
+	int boneOffset = -1;
+	// Mesh-space bounds
+	glm::vec3 localMin;
+	glm::vec3 localMax;
+
+	// Tracking (carried over from the previous frame)
+	ShadowLayer layer = SHADOW_STATIC;
+	// Faces the caster touched when it was last drawn
+	unsigned int faceMask = 0;
+	// Frames since the caster last moved
+	int stillFrames = 0;
+};
+
+// Struct for holding the omnidirectional shadow of the point light
+struct PointShadow {
+	int size = 0;
+	float nearPlane = 0.01f;
+	float farPlane = 50.0f;
+	// Frames a moving caster must stay still before it goes back to the static layer
+	int stillFramesToStatic = 60;
+
+	// Cube depth maps (distance to the light / farPlane) and the framebuffer that renders them
+	GLuint cubeTex[SHADOW_LAYER_CNT] = { 0, 0 };
+	GLuint FBO = 0;
+
+	// Layered program (Shadow.vs/.gs/.fs)
+	GLuint programID = 0;
+	GLint faceMatsLoc = -1;
+	GLint faceMaskLoc = -1;
+	GLint lightPosLoc = -1;
+	GLint farPlaneLoc = -1;
+
+	// Light position the maps were rendered for
+	glm::vec3 lightPos;
+	bool lightValid = false;
+
+	// Faces to re-render this frame, per layer
+	unsigned int dirtyFaces[SHADOW_LAYER_CNT] = { SHADOW_ALL_FACES, SHADOW_ALL_FACES };
+
+	std::vector<ShadowCaster> casters;
+
+	// Statistics
+	long long frameCnt = 0;
+	long long faceRenderCnt = 0;
+};
+
+// Create cube maps and framebuffer (programID is the linked Shadow.vs/.gs/.fs program)
+void createPointShadow(PointShadow &ps, int size, float farPlane, GLuint programID);
+
+// Delete textures, framebuffer and program
+void cleanupPointShadow(PointShadow &ps);
+
+// Faces of a cube map around lightPos whose frustum may contain a box (conservative)
+unsigned int shadowFacesForBounds(glm::vec3 lightPos, glm::vec3 bmin, glm::vec3 bmax);
+
+// Compare this frame's casters with the last frame and mark the faces that must be re-rendered
+// (skinnedMoved: the animation clock stepped or the clip restarted, so every skinned caster counts as moving)
+void updatePointShadow(PointShadow &ps, glm::vec3 lightPos, std::vector<ShadowCaster> &frameCasters, bool skinnedMoved);
+
+// Bind framebuffer and program for one layer and clear its dirty faces (false if nothing to draw)
+bool beginShadowLayer(PointShadow &ps, ShadowLayer layer);
+
+// Mark all faces clean after drawing and unbind the framebuffer
+void endPointShadow(PointShadow &ps);
+
+// Print how many faces were re-rendered
+void printShadowStats(PointShadow &ps);
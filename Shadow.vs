@@ -0,0 +1,29 @@
+#version 430 core
+
+// Same attribute layout as Basic.vs (the scene's meshes are drawn as-is)
+layout(location=0) in vec3 position;
+layout(location=4) in mat4 modelMat;
+layout(location=11) in int boneOffset;
+layout(location=12) in ivec4 boneIDs;
+layout(location=13) in vec4 boneWeights;
+
+// Bone matrices of all skinned instances
+layout(std430, binding=0) readonly buffer BonePalette {
+	mat4 bones[];
+};
+
+void main()
+{
+	// Blend bone matrices (skinned instances only; vertices without weights keep the bind pose)
+	mat4 skinMat = mat4(1.0);
+	float weightSum = boneWeights.x + boneWeights.y + boneWeights.z + boneWeights.w;
+	if(boneOffset >= 0 && weightSum > 0.0) {
+		skinMat = boneWeights.x * bones[boneOffset + boneIDs.x]
+				+ boneWeights.y * bones[boneOffset + boneIDs.y]
+				+ boneWeights.z * bones[boneOffset + boneIDs.z]
+				+ boneWeights.w * bones[boneOffset + boneIDs.w];
+	}
+
+	// World position (the geometry shader projects it onto each cube face)
+	gl_Position = modelMat * skinMat * vec4(position, 1.0);
+}
@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+#include "SoftRaster.hpp"
+#include "stb_image.h"
+#include "stb_image_write.h"
+#if defined(SOFT_RASTER_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+using namespace std;
+
+const int BLOCKS_PER_TILE = SOFT_TILE_SIZE / SOFT_BLOCK_SIZE;
+
+// Clear depth (same as the default glClearDepth)
+const float CLEAR_DEPTH = 1.0f;
+
+// Run job(threadIndex) on threadCnt threads (the calling thread is thread 0)
+template<typename F>
+static void runOnThreads(int threadCnt, F job) {
+	vector<thread> workers;
+	for(int t = 1; t < threadCnt; t++) {
+		workers.push_back(thread(job, t));
+	}
+	job(0);
+	for(thread &w : workers) w.join();
+}
+
+// Milliseconds since a time point
+static double elapsedMs(chrono::steady_clock::time_point start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Does the CPU (and OS) support AVX2?
+static bool cpuHasAVX2() {
+#if defined(SOFT_RASTER_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	// OSXSAVE and AVX, and the OS saves the YMM registers
+	if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return false;
+	if((_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(SOFT_RASTER_AVX2) && (defined(__GNUC__) || defined(__clang__))
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+
+// Set up rasterizer (threadCnt 0 = one per hardware thread)
+void createSoftRasterizer(SoftRasterizer &sr, int threadCnt) {
+	if(threadCnt <= 0) threadCnt = (int)thread::hardware_concurrency();
+	sr.threadCnt = max(1, threadCnt);
+	sr.useAVX2 = cpuHasAVX2();
+	sr.threads.assign(sr.threadCnt, SoftThreadData());
+}
+
+// Allocate framebuffer
+void resizeSoftFramebuffer(SoftFramebuffer &fb, int width, int height) {
+	fb.width = width;
+	fb.height = height;
+	fb.color.assign((size_t)width * height * 4, 0);
+	fb.depth.assign((size_t)width * height, CLEAR_DEPTH);
+}
+
+// Same as Basic.vs
+static void transformVertex(const Vertex &src, const SoftDrawItem &item, const glm::mat4 &modelView,
+		const glm::mat3 &normalView, const glm::mat4 &projMat, SoftVertex &dst) {
+	// Blend bone matrices (skinned instances only; vertices without weights keep the bind pose)
+	glm::mat4 skinMat(1.0f);
+	float weightSum = src.boneWeights.x + src.boneWeights.y + src.boneWeights.z + src.boneWeights.w;
+	if(item.bones && weightSum > 0.0f) {
+		skinMat = item.bones[src.boneIDs.x] * src.boneWeights.x
+				+ item.bones[src.boneIDs.y] * src.boneWeights.y
+				+ item.bones[src.boneIDs.z] * src.boneWeights.z
+				+ item.bones[src.boneIDs.w] * src.boneWeights.w;
+	}
+	glm::vec4 objPos = skinMat * glm::vec4(src.position, 1.0f);
+	glm::vec4 viewPos = modelView * objPos;
+	dst.viewPos = glm::vec3(viewPos);
+	dst.normal = normalView * (glm::mat3(skinMat) * src.normal);
+	dst.clipPos = projMat * viewPos;
+	dst.color = src.color;
+}
+
+// Interpolate clipped vertex
+static SoftVertex lerpVertex(const SoftVertex &a, const SoftVertex &b, float t) {
+	SoftVertex v;
+	v.clipPos = a.clipPos + (b.clipPos - a.clipPos) * t;
+	v.viewPos = a.viewPos + (b.viewPos - a.viewPos) * t;
+	v.normal = a.normal + (b.normal - a.normal) * t;
+	v.color = a.color + (b.color - a.color) * t;
+	return v;
+}
+
+// Can any pixel center in [x0,x1]x[y0,y1] be inside the triangle? (tests the best corner of every edge)
+static inline bool overlapsRect(const SoftTriangle &tri, float x0, float y0, float x1, float y1) {
+	for(int i = 0; i < 3; i++) {
+		float x = (tri.edgeA[i] >= 0.0f) ? x1 : x0;
+		float y = (tri.edgeB[i] >= 0.0f) ? y1 : y0;
+		if(tri.edgeA[i] * x + tri.edgeB[i] * y + tri.edgeC[i] < 0.0f) return false;
+	}
+	return true;
+}
+
+// Project triangle to the screen, build edge/depth planes and add it to the tiles it covers
+static void setupTriangle(const SoftVertex *tv[3], int v0, int v1, int v2, bool clipped, int item,
+		int width, int height, int tilesX, SoftThreadData &td) {
+	float x[3], y[3], z[3], invW[3];
+	for(int i = 0; i < 3; i++) {
+		invW[i] = 1.0f / tv[i]->clipPos.w;
+		x[i] = (tv[i]->clipPos.x * invW[i] * 0.5f + 0.5f) * width;
+		y[i] = (0.5f - tv[i]->clipPos.y * invW[i] * 0.5f) * height;
+		z[i] = tv[i]->clipPos.z * invW[i] * 0.5f + 0.5f;
+	}
+
+	float area2 = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if(fabs(area2) < 1e-8f) return;
+
+	// Pixel bounds (pixel centers at +0.5)
+	int minX = max(0, (int)floor(min(x[0], min(x[1], x[2])) - 0.5f));
+	int maxX = min(width - 1, (int)ceil(max(x[0], max(x[1], x[2])) - 0.5f));
+	int minY = max(0, (int)floor(min(y[0], min(y[1], y[2])) - 0.5f));
+	int maxY = min(height - 1, (int)ceil(max(y[0], max(y[1], y[2])) - 0.5f));
+	if(minX > maxX || minY > maxY) return;
+
+	SoftTriangle tri;
+	// Edge i runs from vertex i to i+1; scaling by -1/area makes it 1 at the opposite vertex
+	float scale = -1.0f / area2;
+	for(int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		float A = (y[j] - y[i]) * scale;
+		float B = -(x[j] - x[i]) * scale;
+		tri.edgeA[i] = A;
+		tri.edgeB[i] = B;
+		tri.edgeC[i] = -x[i] * A - y[i] * B;
+	}
+
+	// Barycentrics: vertex 0 = edge 1, vertex 1 = edge 2, vertex 2 = edge 0
+	tri.zA = tri.edgeA[1] * z[0] + tri.edgeA[2] * z[1] + tri.edgeA[0] * z[2];
+	tri.zB = tri.edgeB[1] * z[0] + tri.edgeB[2] * z[1] + tri.edgeB[0] * z[2];
+	tri.zC = tri.edgeC[1] * z[0] + tri.edgeC[2] * z[1] + tri.edgeC[0] * z[2];
+	tri.minZ = min(z[0], min(z[1], z[2]));
+	if(tri.minZ >= CLEAR_DEPTH) return;
+
+	for(int i = 0; i < 3; i++) tri.invW[i] = invW[i];
+	tri.minX = minX;
+	tri.minY = minY;
+	tri.maxX = maxX;
+	tri.maxY = maxY;
+	tri.v[0] = v0;
+	tri.v[1] = v1;
+	tri.v[2] = v2;
+	tri.clipped = clipped;
+	tri.item = item;
+
+	// Add to every tile the triangle may touch
+	int index = (int)td.triangles.size();
+	td.triangles.push_back(tri);
+	for(int ty = minY / SOFT_TILE_SIZE; ty <= maxY / SOFT_TILE_SIZE; ty++) {
+		for(int tx = minX / SOFT_TILE_SIZE; tx <= maxX / SOFT_TILE_SIZE; tx++) {
+			float tileX = (float)(tx * SOFT_TILE_SIZE);
+			float tileY = (float)(ty * SOFT_TILE_SIZE);
+			if(!overlapsRect(tri, tileX + 0.5f, tileY + 0.5f,
+					tileX + SOFT_TILE_SIZE - 0.5f, tileY + SOFT_TILE_SIZE - 0.5f)) continue;
+			td.bins[ty * tilesX + tx].push_back(index);
+		}
+	}
+}
+
+// Reject, clip against the near plane and set up one triangle
+static void clipAndSetupTriangle(vector<SoftVertex> &vertices, int i0, int i1, int i2, int item,
+		int width, int height, int tilesX, SoftThreadData &td) {
+	const SoftVertex *tv[3] = { &vertices[i0], &vertices[i1], &vertices[i2] };
+
+	// Entirely outside one frustum plane?
+	int outAll = 0x3F;
+	int outAny = 0;
+	for(int i = 0; i < 3; i++) {
+		glm::vec4 c = tv[i]->clipPos;
+		int out = 0;
+		if(c.x < -c.w) out |= 1;
+		if(c.x > c.w) out |= 2;
+		if(c.y < -c.w) out |= 4;
+		if(c.y > c.w) out |= 8;
+		if(c.z < -c.w) out |= 16;
+		if(c.z > c.w) out |= 32;
+		outAll &= out;
+		outAny |= out;
+	}
+	if(outAll) return;
+
+	// The other planes are handled by the screen bounds and the depth test
+	if(!(outAny & 16)) {
+		setupTriangle(tv, i0, i1, i2, false, item, width, height, tilesX, td);
+		return;
+	}
+
+	// Clip against the near plane (z >= -w), giving up to 4 vertices
+	SoftVertex poly[4];
+	int polyCnt = 0;
+	for(int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		float di = tv[i]->clipPos.z + tv[i]->clipPos.w;
+		float dj = tv[j]->clipPos.z + tv[j]->clipPos.w;
+		if(di >= 0.0f) poly[polyCnt++] = *tv[i];
+		if((di >= 0.0f) != (dj >= 0.0f)) {
+			poly[polyCnt++] = lerpVertex(*tv[i], *tv[j], di / (di - dj));
+		}
+	}
+	if(polyCnt < 3) return;
+
+	int base = (int)td.clipVertices.size();
+	for(int i = 0; i < polyCnt; i++) td.clipVertices.push_back(poly[i]);
+	for(int i = 1; i + 1 < polyCnt; i++) {
+		const SoftVertex *cv[3] = { &td.clipVertices[base], &td.clipVertices[base + i], &td.clipVertices[base + i + 1] };
+		setupTriangle(cv, base, base + i, base + i + 1, true, item, width, height, tilesX, td);
+	}
+}
+
+// Depth test and write one 8x8 block (visibility buffer: depth + triangle id); returns true if anything was written
+// Edge and depth values are stepped row by row exactly like the AVX2 kernel, so both give the same image
+static inline bool rasterBlock(const SoftTriangle &tri, float bx, float by, float *depth, int *ids, int id) {
+	float py = by + 0.5f;
+	float e0[SOFT_BLOCK_SIZE], e1[SOFT_BLOCK_SIZE], e2[SOFT_BLOCK_SIZE], z[SOFT_BLOCK_SIZE];
+	for(int col = 0; col < SOFT_BLOCK_SIZE; col++) {
+		float px = (bx + 0.5f) + (float)col;
+		e0[col] = tri.edgeA[0] * px + (tri.edgeB[0] * py + tri.edgeC[0]);
+		e1[col] = tri.edgeA[1] * px + (tri.edgeB[1] * py + tri.edgeC[1]);
+		e2[col] = tri.edgeA[2] * px + (tri.edgeB[2] * py + tri.edgeC[2]);
+		z[col] = tri.zA * px + (tri.zB * py + tri.zC);
+	}
+
+	bool written = false;
+	for(int row = 0; row < SOFT_BLOCK_SIZE; row++) {
+		for(int col = 0; col < SOFT_BLOCK_SIZE; col++) {
+			if(e0[col] >= 0.0f && e1[col] >= 0.0f && e2[col] >= 0.0f) {
+				float &d = depth[row * SOFT_TILE_SIZE + col];
+				if(z[col] < d) {
+					d = z[col];
+					ids[row * SOFT_TILE_SIZE + col] = id;
+					written = true;
+				}
+			}
+			e0[col] += tri.edgeB[0];
+			e1[col] += tri.edgeB[1];
+			e2[col] += tri.edgeB[2];
+			z[col] += tri.zB;
+		}
+	}
+	return written;
+}
+
+// Farthest depth in one 8x8 block
+static inline float blockMaxDepth(const float *depth) {
+	float result = depth[0];
+	for(int row = 0; row < SOFT_BLOCK_SIZE; row++) {
+		for(int col = 0; col < SOFT_BLOCK_SIZE; col++) {
+			result = max(result, depth[row * SOFT_TILE_SIZE + col]);
+		}
+	}
+	return result;
+}
+
+// Block kernels for the rasterizer's instruction set
+static inline bool rasterBlockFor([[maybe_unused]] bool avx2, const SoftTriangle &tri, float bx, float by,
+		float *depth, int *ids, int id) {
+#if defined(SOFT_RASTER_AVX2)
+	if(avx2) return rasterBlockAVX2(tri, bx, by, depth, ids, id);
+#endif
+	return rasterBlock(tri, bx, by, depth, ids, id);
+}
+
+static inline float blockMaxDepthFor([[maybe_unused]] bool avx2, const float *depth) {
+#if defined(SOFT_RASTER_AVX2)
+	if(avx2) return blockMaxDepthAVX2(depth);
+#endif
+	return blockMaxDepth(depth);
+}
+
+// Same as the lit path of Basic.fs (untextured)
+static glm::vec3 shadePixel(glm::vec3 N, glm::vec3 viewPos, glm::vec3 albedo, const SoftDrawItem &item, const SoftFrame &frame) {
+	if(item.unlit) return albedo;
+
+	const float pi = 3.14159265359f;
+	float metallic = item.metallic;
+	float roughness = item.roughness;
+
+	glm::vec3 V = glm::normalize(-viewPos);
+	glm::vec3 f0 = glm::mix(glm::vec3(0.04f), albedo, metallic);
+	glm::vec3 L = glm::normalize(glm::vec3(frame.lightPos) - viewPos);
+	glm::vec3 H = glm::normalize(L + V);
+
+	// Fresnel
+	float m = 1.0f - max(0.0f, glm::dot(L, H));
+	float weight = m * m * m * m * m;
+	glm::vec3 F = f0 + (glm::vec3(1.0f) - f0) * weight;
+	glm::vec3 kS = F;
+	glm::vec3 kD = glm::vec3(1.0f) - kS;
+
+	// Normal distribution
+	float a2 = roughness * roughness;
+	a2 = a2 * a2;
+	float NdotH = glm::dot(N, H);
+	float d = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+	float NDF = a2 / (pi * d * d);
+
+	// Schlick geometry
+	float k = ((roughness + 1.0f) * (roughness + 1.0f)) / 8.0f;
+	float NdotL = glm::dot(N, L);
+	float NdotV = glm::dot(N, V);
+	float G = (NdotL / (NdotL * (1.0f - k) + k)) * (NdotV / (NdotV * (1.0f - k) + k));
+	kS = kS * (NDF * G);
+
+	return (kD + kS) * glm::vec3(frame.lightColor) * max(0.0f, NdotL);
+}
+
+// Render draw items into the framebuffer
+void renderSoftware(SoftRasterizer &sr, vector<SoftDrawItem> &items, SoftFrame &frame, SoftFramebuffer &fb) {
+	int threadCnt = sr.threadCnt;
+	int width = fb.width;
+	int height = fb.height;
+	int tilesX = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	int tilesY = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	int tileCnt = tilesX * tilesY;
+
+	// Where each item's vertices and triangles start
+	vector<int> vertexBase(items.size() + 1, 0);
+	vector<long long> triangleStart(items.size() + 1, 0);
+	vector<glm::mat4> modelView(items.size());
+	vector<glm::mat3> normalView(items.size());
+	for(unsigned int i = 0; i < items.size(); i++) {
+		vertexBase[i + 1] = vertexBase[i] + (int)items[i].mesh->vertices.size();
+		triangleStart[i + 1] = triangleStart[i] + items[i].mesh->indices.size() / 3;
+		modelView[i] = frame.viewMat * items[i].modelMat;
+		normalView[i] = glm::mat3(frame.viewMat) * items[i].normMat;
+	}
+	int vertexCnt = vertexBase.back();
+	long long triangleCnt = triangleStart.back();
+
+	// Vertex stage
+	auto start = chrono::steady_clock::now();
+	sr.vertices.resize(vertexCnt);
+	runOnThreads(threadCnt, [&](int t) {
+		int begin = (int)((long long)vertexCnt * t / threadCnt);
+		int end = (int)((long long)vertexCnt * (t + 1) / threadCnt);
+		if(begin >= end) return;
+		int item = (int)(upper_bound(vertexBase.begin(), vertexBase.end(), begin) - vertexBase.begin()) - 1;
+		for(int i = begin; i < end; i++) {
+			while(i >= vertexBase[item + 1]) item++;
+			transformVertex(items[item].mesh->vertices[i - vertexBase[item]], items[item],
+				modelView[item], normalView[item], frame.projMat, sr.vertices[i]);
+		}
+	});
+	sr.stats.vertexMs = elapsedMs(start);
+
+	// Setup and binning: each thread takes a contiguous range, so bins stay in submission order
+	start = chrono::steady_clock::now();
+	runOnThreads(threadCnt, [&](int t) {
+		SoftThreadData &td = sr.threads[t];
+		td.triangles.clear();
+		td.clipVertices.clear();
+		td.bins.resize(tileCnt);
+		for(vector<int> &bin : td.bins) bin.clear();
+
+		long long begin = triangleCnt * t / threadCnt;
+		long long end = triangleCnt * (t + 1) / threadCnt;
+		if(begin >= end) return;
+		int item = (int)(upper_bound(triangleStart.begin(), triangleStart.end(), begin) - triangleStart.begin()) - 1;
+		for(long long i = begin; i < end; i++) {
+			while(i >= triangleStart[item + 1]) item++;
+			const vector<unsigned int> &indices = items[item].mesh->indices;
+			size_t k = (size_t)(i - triangleStart[item]) * 3;
+			int base = vertexBase[item];
+			clipAndSetupTriangle(sr.vertices, base + indices[k], base + indices[k + 1], base + indices[k + 2],
+				item, width, height, tilesX, td);
+		}
+	});
+	vector<int> threadBase(threadCnt, 0);
+	int setupCnt = 0;
+	for(int t = 0; t < threadCnt; t++) {
+		sr.threads[t].triangleBase = setupCnt;
+		threadBase[t] = setupCnt;
+		setupCnt += (int)sr.threads[t].triangles.size();
+	}
+	sr.stats.triangleCnt = setupCnt;
+	sr.stats.binMs = elapsedMs(start);
+
+	// Raster and shade tiles
+	start = chrono::steady_clock::now();
+	glm::vec4 clear = glm::clamp(frame.clearColor, 0.0f, 1.0f) * 255.0f;
+	atomic<int> nextTile(0);
+	bool avx2 = sr.useAVX2;
+	runOnThreads(threadCnt, [&](int) {
+		vector<float> depth(SOFT_TILE_SIZE * SOFT_TILE_SIZE);
+		vector<int> ids(SOFT_TILE_SIZE * SOFT_TILE_SIZE);
+		float blockMaxZ[BLOCKS_PER_TILE * BLOCKS_PER_TILE];
+
+		while(true) {
+			int tile = nextTile++;
+			if(tile >= tileCnt) break;
+			int tileX = (tile % tilesX) * SOFT_TILE_SIZE;
+			int tileY = (tile / tilesX) * SOFT_TILE_SIZE;
+			fill(depth.begin(), depth.end(), CLEAR_DEPTH);
+			fill(ids.begin(), ids.end(), -1);
+			fill(blockMaxZ, blockMaxZ + BLOCKS_PER_TILE * BLOCKS_PER_TILE, CLEAR_DEPTH);
+			float tileMaxZ = CLEAR_DEPTH;
+
+			// Hierarchical depth: skip the tile, then each 8x8 block, if the triangle is behind everything there
+			for(int bt = 0; bt < threadCnt; bt++) {
+				SoftThreadData &td = sr.threads[bt];
+				for(int index : td.bins[tile]) {
+					const SoftTriangle &tri = td.triangles[index];
+					if(tri.minZ >= tileMaxZ) continue;
+
+					// Only the blocks under the triangle's bounds
+					int bx0 = (max(tri.minX, tileX) - tileX) / SOFT_BLOCK_SIZE;
+					int by0 = (max(tri.minY, tileY) - tileY) / SOFT_BLOCK_SIZE;
+					int bx1 = (min(tri.maxX, tileX + SOFT_TILE_SIZE - 1) - tileX) / SOFT_BLOCK_SIZE;
+					int by1 = (min(tri.maxY, tileY + SOFT_TILE_SIZE - 1) - tileY) / SOFT_BLOCK_SIZE;
+
+					bool written = false;
+					for(int by = by0; by <= by1; by++) {
+						float blockY = (float)(tileY + by * SOFT_BLOCK_SIZE);
+						for(int bx = bx0; bx <= bx1; bx++) {
+							int block = by * BLOCKS_PER_TILE + bx;
+							float blockX = (float)(tileX + bx * SOFT_BLOCK_SIZE);
+							if(tri.minZ >= blockMaxZ[block]) continue;
+							if(!overlapsRect(tri, blockX + 0.5f, blockY + 0.5f,
+									blockX + SOFT_BLOCK_SIZE - 0.5f, blockY + SOFT_BLOCK_SIZE - 0.5f)) continue;
+
+							int offset = by * SOFT_BLOCK_SIZE * SOFT_TILE_SIZE + bx * SOFT_BLOCK_SIZE;
+							if(rasterBlockFor(avx2, tri, blockX, blockY, &depth[offset], &ids[offset], td.triangleBase + index)) {
+								blockMaxZ[block] = blockMaxDepthFor(avx2, &depth[offset]);
+								written = true;
+							}
+						}
+					}
+					if(written) {
+						tileMaxZ = *max_element(blockMaxZ, blockMaxZ + BLOCKS_PER_TILE * BLOCKS_PER_TILE);
+					}
+				}
+			}
+
+			// Shade each visible pixel once
+			for(int y = tileY; y < min(height, tileY + SOFT_TILE_SIZE); y++) {
+				for(int x = tileX; x < min(width, tileX + SOFT_TILE_SIZE); x++) {
+					int local = (y - tileY) * SOFT_TILE_SIZE + (x - tileX);
+					size_t pixel = (size_t)y * width + x;
+					fb.depth[pixel] = depth[local];
+					unsigned char *out = &fb.color[pixel * 4];
+					int id = ids[local];
+					if(id < 0) {
+						for(int c = 0; c < 4; c++) out[c] = (unsigned char)(clear[c] + 0.5f);
+						continue;
+					}
+
+					int owner = (int)(upper_bound(threadBase.begin(), threadBase.end(), id) - threadBase.begin()) - 1;
+					SoftThreadData &td = sr.threads[owner];
+					const SoftTriangle &tri = td.triangles[id - threadBase[owner]];
+					const vector<SoftVertex> &source = tri.clipped ? td.clipVertices : sr.vertices;
+
+					// Perspective-correct barycentrics
+					float px = x + 0.5f;
+					float py = y + 0.5f;
+					float b[3];
+					for(int i = 0; i < 3; i++) {
+						b[(i + 2) % 3] = (tri.edgeA[i] * px + tri.edgeB[i] * py + tri.edgeC[i]) * tri.invW[(i + 2) % 3];
+					}
+					float sum = b[0] + b[1] + b[2];
+					glm::vec3 viewPos(0.0f), normal(0.0f);
+					glm::vec4 color(0.0f);
+					for(int i = 0; i < 3; i++) {
+						const SoftVertex &v = source[tri.v[i]];
+						float w = b[i] / sum;
+						viewPos += v.viewPos * w;
+						normal += v.normal * w;
+						color += v.color * w;
+					}
+
+					glm::vec3 shaded = shadePixel(glm::normalize(normal), viewPos, glm::vec3(color),
+						items[tri.item], frame);
+					shaded = glm::clamp(shaded, 0.0f, 1.0f) * 255.0f;
+					out[0] = (unsigned char)(shaded.x + 0.5f);
+					out[1] = (unsigned char)(shaded.y + 0.5f);
+					out[2] = (unsigned char)(shaded.z + 0.5f);
+					out[3] = 255;
+				}
+			}
+		}
+	});
+	sr.stats.rasterMs = elapsedMs(start);
+}
+
+// Save color as PNG
+bool writeSoftFramebufferPNG(SoftFramebuffer &fb, string filename) {
+	return stbi_write_png(filename.c_str(), fb.width, fb.height, 4, fb.color.data(), fb.width * 4) != 0;
+}
+
+// Root mean square difference to a golden image (0-255 scale; -1 if it cannot be compared)
+double compareWithGolden(SoftFramebuffer &fb, string filename) {
+	int w, h, channels;
+	unsigned char *golden = stbi_load(filename.c_str(), &w, &h, &channels, 4);
+	if(!golden) return -1.0;
+	if(w != fb.width || h != fb.height) {
+		stbi_image_free(golden);
+		return -1.0;
+	}
+
+	double sum = 0.0;
+	size_t pixelCnt = (size_t)w * h;
+	for(size_t i = 0; i < pixelCnt; i++) {
+		for(int c = 0; c < 3; c++) {
+			double diff = (double)fb.color[i * 4 + c] - golden[i * 4 + c];
+			sum += diff * diff;
+		}
+	}
+	stbi_image_free(golden);
+	return sqrt(sum / (pixelCnt * 3));
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "Mesh.hpp"
+
+// Screen tiles (binned and rasterized independently) and depth blocks inside them
+const int SOFT_TILE_SIZE = 64;
+const int SOFT_BLOCK_SIZE = 8;
+
+// One instance to draw (same inputs as Basic.vs/Basic.fs)
+struct SoftDrawItem {
+	const Mesh *mesh = nullptr;
+	glm::mat4 modelMat;
+	glm::mat3 normMat;
+	// Bone matrices of this instance (nullptr if not skinned)
+	const glm::mat4 *bones = nullptr;
+	float metallic = 0.0f;
+	float roughness = 0.1f;
+	bool unlit = false;
+};
+
+// Per-frame values (same as the uniforms of Basic.vs/Basic.fs)
+struct SoftFrame {
+	glm::mat4 viewMat;
+	glm::mat4 projMat;
+	// Light position in view space
+	glm::vec4 lightPos;
+	glm::vec4 lightColor;
+	glm::vec4 clearColor;
+};
+
+// Color (RGBA8, first row is the top of the image) and depth
+struct SoftFramebuffer {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> color;
+	std::vector<float> depth;
+};
+
+// Transformed vertex
+struct SoftVertex {
+	glm::vec4 clipPos;
+	glm::vec3 viewPos;
+	glm::vec3 normal;
+	glm::vec4 color;
+};
+
+// Triangle after setup
+struct SoftTriangle {
+	// Edge functions A*x + B*y + C, scaled so each one is the barycentric of the opposite vertex
+	float edgeA[3];
+	float edgeB[3];
+	float edgeC[3];
+	// Depth plane
+	float zA, zB, zC;
+	float minZ;
+	float invW[3];
+	// Pixel bounds
+	int minX, minY, maxX, maxY;
+	// Vertices: shared vertex indices, or indices into the thread's clip vertices
+	int v[3];
+	bool clipped;
+	int item;
+};
+
+// Work each thread produces while setting up its range of triangles
+struct SoftThreadData {
+	std::vector<SoftTriangle> triangles;
+	std::vector<SoftVertex> clipVertices;
+	// Triangle indices per screen tile (kept in submission order)
+	std::vector<std::vector<int>> bins;
+	// Id of this thread's first triangle in the visibility buffer
+	int triangleBase = 0;
+};
+
+// Timings of the last frame
+struct SoftRasterStats {
+	double vertexMs = 0.0;
+	double binMs = 0.0;
+	double rasterMs = 0.0;
+	int triangleCnt = 0;
+};
+
+// Struct for holding the software rasterizer (buffers are reused between frames)
+struct SoftRasterizer {
+	int threadCnt = 1;
+	// Use the AVX2 block kernels (set if they were built and the CPU supports them)
+	bool useAVX2 = false;
+	std::vector<SoftVertex> vertices;
+	std::vector<SoftThreadData> threads;
+	SoftRasterStats stats;
+};
+
+#if defined(SOFT_RASTER_AVX2)
+// AVX2 block kernels (SoftRasterAVX2.cpp, the only file compiled with AVX2)
+bool rasterBlockAVX2(const SoftTriangle &tri, float bx, float by, float *depth, int *ids, int id);
+float blockMaxDepthAVX2(const float *depth);
+#endif
+
+// Set up rasterizer (threadCnt 0 = one per hardware thread)
+void createSoftRasterizer(SoftRasterizer &sr, int threadCnt);
+
+// Allocate framebuffer
+void resizeSoftFramebuffer(SoftFramebuffer &fb, int width, int height);
+
+// Render draw items into the framebuffer
+void renderSoftware(SoftRasterizer &sr, std::vector<SoftDrawItem> &items, SoftFrame &frame, SoftFramebuffer &fb);
+
+// Save color as PNG
+bool writeSoftFramebufferPNG(SoftFramebuffer &fb, std::string filename);
+
+// Root mean square difference to a golden image (0-255 scale; -1 if it cannot be compared)
+double compareWithGolden(SoftFramebuffer &fb, std::string filename);
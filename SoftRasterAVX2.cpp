@@ -0,0 +1,55 @@
+#include <algorithm>
+#include "SoftRaster.hpp"
+#if defined(SOFT_RASTER_AVX2)
+#include <immintrin.h>
+using namespace std;
+
+// Depth test and write one 8x8 block, one row of 8 pixels per step (see rasterBlock in SoftRaster.cpp)
+bool rasterBlockAVX2(const SoftTriangle &tri, float bx, float by, float *depth, int *ids, int id) {
+	__m256 laneX = _mm256_add_ps(_mm256_set1_ps(bx + 0.5f), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+	float py = by + 0.5f;
+	__m256 e0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.edgeA[0]), laneX), _mm256_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]));
+	__m256 e1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.edgeA[1]), laneX), _mm256_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]));
+	__m256 e2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.edgeA[2]), laneX), _mm256_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]));
+	__m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.zA), laneX), _mm256_set1_ps(tri.zB * py + tri.zC));
+	__m256 step0 = _mm256_set1_ps(tri.edgeB[0]);
+	__m256 step1 = _mm256_set1_ps(tri.edgeB[1]);
+	__m256 step2 = _mm256_set1_ps(tri.edgeB[2]);
+	__m256 stepZ = _mm256_set1_ps(tri.zB);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 idv = _mm256_castsi256_ps(_mm256_set1_epi32(id));
+
+	bool written = false;
+	for(int row = 0; row < SOFT_BLOCK_SIZE; row++) {
+		float *depthRow = depth + row * SOFT_TILE_SIZE;
+		float *idRow = (float *)(ids + row * SOFT_TILE_SIZE);
+		__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+			_mm256_cmp_ps(e1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+		__m256 d = _mm256_loadu_ps(depthRow);
+		__m256 mask = _mm256_and_ps(inside, _mm256_cmp_ps(z, d, _CMP_LT_OQ));
+		if(!_mm256_testz_ps(mask, mask)) {
+			_mm256_storeu_ps(depthRow, _mm256_blendv_ps(d, z, mask));
+			_mm256_storeu_ps(idRow, _mm256_blendv_ps(_mm256_loadu_ps(idRow), idv, mask));
+			written = true;
+		}
+		e0 = _mm256_add_ps(e0, step0);
+		e1 = _mm256_add_ps(e1, step1);
+		e2 = _mm256_add_ps(e2, step2);
+		z = _mm256_add_ps(z, stepZ);
+	}
+	return written;
+}
+
+// Farthest depth in one 8x8 block
+float blockMaxDepthAVX2(const float *depth) {
+	__m256 m = _mm256_loadu_ps(depth);
+	for(int row = 1; row < SOFT_BLOCK_SIZE; row++) {
+		m = _mm256_max_ps(m, _mm256_loadu_ps(depth + row * SOFT_TILE_SIZE));
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, m);
+	float result = lanes[0];
+	for(int i = 1; i < 8; i++) result = max(result, lanes[i]);
+	return result;
+}
+#endif
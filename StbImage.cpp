@@ -0,0 +1,5 @@
+// stb_image and stb_image_write implementations (compiled once, used by Texture.cpp and SoftRaster.cpp)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
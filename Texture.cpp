@@ -0,0 +1,584 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "Texture.hpp"
+#include "stb_image.h"
+using namespace std;
+
+// Number of pixel buffers in the upload ring
+const int PBO_RING_SIZE = 3;
+
+// Version written into cache files (bump when the encoder changes)
+const uint32_t CACHE_VERSION = 1;
+
+// FNV-1a hash (used to name cache files)
+static uint64_t hashBytes(const void *data, size_t size, uint64_t h = 14695981039346656037ULL) {
+	const unsigned char *bytes = (const unsigned char*)data;
+	for(size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+// Size in bytes of one level in a given format
+static size_t levelSize(int width, int height, bool compressed) {
+	if(compressed) {
+		return (size_t)max(1, (width + 3) / 4) * max(1, (height + 3) / 4) * 8;
+	}
+	return (size_t)width * height * 4;
+}
+
+// Generate the rest of the mip chain from level 0 (2x2 box filter)
+void generateMipChain(vector<TextureLevel> &levels) {
+	levels.resize(1);
+	while(levels.back().width > 1 || levels.back().height > 1) {
+		const TextureLevel &src = levels.back();
+		TextureLevel dst;
+		dst.width = max(1, src.width / 2);
+		dst.height = max(1, src.height / 2);
+		dst.data.resize((size_t)dst.width * dst.height * 4);
+
+		for(int y = 0; y < dst.height; y++) {
+			int y0 = min(2*y, src.height - 1);
+			int y1 = min(2*y + 1, src.height - 1);
+			for(int x = 0; x < dst.width; x++) {
+				int x0 = min(2*x, src.width - 1);
+				int x1 = min(2*x + 1, src.width - 1);
+				const unsigned char *p00 = &src.data[((size_t)y0*src.width + x0)*4];
+				const unsigned char *p01 = &src.data[((size_t)y0*src.width + x1)*4];
+				const unsigned char *p10 = &src.data[((size_t)y1*src.width + x0)*4];
+				const unsigned char *p11 = &src.data[((size_t)y1*src.width + x1)*4];
+				unsigned char *out = &dst.data[((size_t)y*dst.width + x)*4];
+				for(int c = 0; c < 4; c++) {
+					out[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) >> 2);
+				}
+			}
+		}
+		levels.push_back(move(dst));
+	}
+}
+
+// Pack 8-bit color into 5:6:5
+static uint16_t packRGB565(const int *c) {
+	return (uint16_t)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+// Expand 5:6:5 back to 8-bit color
+static void unpackRGB565(uint16_t v, int *c) {
+	int r = (v >> 11) & 31;
+	int g = (v >> 5) & 63;
+	int b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// Encode one 4x4 block of RGBA pixels to BC1 (8 bytes)
+static void encodeBC1Block(const unsigned char block[16][4], unsigned char *out) {
+	// Bounding box and mean of the block
+	int lo[3] = { 255, 255, 255 };
+	int hi[3] = { 0, 0, 0 };
+	int mean[3] = { 0, 0, 0 };
+	for(int i = 0; i < 16; i++) {
+		for(int c = 0; c < 3; c++) {
+			lo[c] = min(lo[c], (int)block[i][c]);
+			hi[c] = max(hi[c], (int)block[i][c]);
+			mean[c] += block[i][c];
+		}
+	}
+	for(int c = 0; c < 3; c++) mean[c] = (mean[c] + 8) / 16;
+
+	// Pick the box diagonal: flip channels that move against green
+	int covRG = 0, covBG = 0;
+	for(int i = 0; i < 16; i++) {
+		int g = block[i][1] - mean[1];
+		covRG += (block[i][0] - mean[0]) * g;
+		covBG += (block[i][2] - mean[2]) * g;
+	}
+	if(covRG < 0) swap(lo[0], hi[0]);
+	if(covBG < 0) swap(lo[2], hi[2]);
+
+	// Inset the endpoints a little (reduces error at the extremes)
+	for(int c = 0; c < 3; c++) {
+		int inset = (hi[c] - lo[c]) / 16;
+		hi[c] = min(255, max(0, hi[c] - inset));
+		lo[c] = min(255, max(0, lo[c] + inset));
+	}
+
+	uint16_t c0 = packRGB565(hi);
+	uint16_t c1 = packRGB565(lo);
+	if(c0 < c1) swap(c0, c1);
+
+	// Four-color palette (c0 > c1); equal endpoints just use index 0
+	int palette[4][3];
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	for(int c = 0; c < 3; c++) {
+		palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+	}
+
+	uint32_t indices = 0;
+	if(c0 != c1) {
+		for(int i = 0; i < 16; i++) {
+			int best = 0;
+			int bestDist = INT32_MAX;
+			for(int p = 0; p < 4; p++) {
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int dist = dr*dr + dg*dg + db*db;
+				if(dist < bestDist) {
+					bestDist = dist;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (2*i);
+		}
+	}
+
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	out[4] = (unsigned char)(indices & 0xFF);
+	out[5] = (unsigned char)((indices >> 8) & 0xFF);
+	out[6] = (unsigned char)((indices >> 16) & 0xFF);
+	out[7] = (unsigned char)(indices >> 24);
+}
+
+// Encode an RGBA8 level to BC1
+void encodeBC1(const TextureLevel &src, TextureLevel &dst) {
+	int blocksX = max(1, (src.width + 3) / 4);
+	int blocksY = max(1, (src.height + 3) / 4);
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.data.resize((size_t)blocksX * blocksY * 8);
+
+	unsigned char block[16][4];
+	for(int by = 0; by < blocksY; by++) {
+		for(int bx = 0; bx < blocksX; bx++) {
+			// Gather block (clamping at the edges of small levels)
+			for(int i = 0; i < 16; i++) {
+				int x = min(bx*4 + (i % 4), src.width - 1);
+				int y = min(by*4 + (i / 4), src.height - 1);
+				memcpy(block[i], &src.data[((size_t)y*src.width + x)*4], 4);
+			}
+			encodeBC1Block(block, &dst.data[((size_t)by*blocksX + bx)*8]);
+		}
+	}
+}
+
+// Name of the cache file for a texture source
+static string getCachePath(const TextureSettings &settings, const string &path, const vector<unsigned char> &embedded) {
+	uint64_t h = hashBytes(&CACHE_VERSION, sizeof(CACHE_VERSION));
+	if(!embedded.empty()) {
+		h = hashBytes(embedded.data(), embedded.size(), h);
+	}
+	else {
+		// Key on path, size and modification time so edited images are re-encoded
+		error_code ec;
+		h = hashBytes(path.data(), path.size(), h);
+		uintmax_t fileSize = filesystem::file_size(path, ec);
+		h = hashBytes(&fileSize, sizeof(fileSize), h);
+		auto stamp = filesystem::last_write_time(path, ec).time_since_epoch().count();
+		h = hashBytes(&stamp, sizeof(stamp), h);
+	}
+	ostringstream name;
+	name << hex << h << ".bc1";
+	return (filesystem::path(settings.cacheDir) / name.str()).string();
+}
+
+// Read a BC1 mip chain from the cache; returns false if missing or stale
+static bool readCache(const string &cachePath, vector<TextureLevel> &levels) {
+	ifstream file(cachePath, ios::binary);
+	if(!file) return false;
+
+	char magic[4];
+	uint32_t version = 0, levelCnt = 0;
+	file.read(magic, 4);
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&levelCnt, sizeof(levelCnt));
+	if(!file || memcmp(magic, "BGTX", 4) != 0 || version != CACHE_VERSION || levelCnt == 0 || levelCnt > 32) {
+		return false;
+	}
+
+	levels.resize(levelCnt);
+	for(TextureLevel &level : levels) {
+		int32_t w = 0, h = 0;
+		file.read((char*)&w, sizeof(w));
+		file.read((char*)&h, sizeof(h));
+		if(!file || w <= 0 || h <= 0) return false;
+		level.width = w;
+		level.height = h;
+		level.data.resize(levelSize(w, h, true));
+		file.read((char*)level.data.data(), level.data.size());
+	}
+	return (bool)file;
+}
+
+// Write a BC1 mip chain to the cache (failures are not fatal)
+static void writeCache(const string &cachePath, const vector<TextureLevel> &levels) {
+	error_code ec;
+	filesystem::create_directories(filesystem::path(cachePath).parent_path(), ec);
+
+	// Write to a temporary name first so a crash never leaves a truncated entry
+	string tmpPath = cachePath + ".tmp";
+	ofstream file(tmpPath, ios::binary);
+	if(!file) return;
+
+	uint32_t levelCnt = (uint32_t)levels.size();
+	file.write("BGTX", 4);
+	file.write((const char*)&CACHE_VERSION, sizeof(CACHE_VERSION));
+	file.write((const char*)&levelCnt, sizeof(levelCnt));
+	for(const TextureLevel &level : levels) {
+		int32_t w = level.width, h = level.height;
+		file.write((const char*)&w, sizeof(w));
+		file.write((const char*)&h, sizeof(h));
+		file.write((const char*)level.data.data(), level.data.size());
+	}
+	file.close();
+	filesystem::rename(tmpPath, cachePath, ec);
+}
+
+// Decode (or fetch from cache) one texture; runs on a worker thread
+static bool decodeTexture(const TextureSettings &settings, bool canCompress,
+		const string &path, const vector<unsigned char> &embedded,
+		vector<TextureLevel> &levels, bool &compressed) {
+
+	string cachePath;
+	if(canCompress) {
+		cachePath = getCachePath(settings, path, embedded);
+		if(readCache(cachePath, levels)) {
+			compressed = true;
+			return true;
+		}
+	}
+
+	// Decode to RGBA8
+	int w, h, channels;
+	stbi_uc *pixels = nullptr;
+	if(!embedded.empty()) {
+		pixels = stbi_load_from_memory(embedded.data(), (int)embedded.size(), &w, &h, &channels, 4);
+	}
+	else {
+		pixels = stbi_load(path.c_str(), &w, &h, &channels, 4);
+	}
+	if(!pixels) {
+		cerr << "ERROR: Could not load texture: " << path << " (" << stbi_failure_reason() << ")" << endl;
+		return false;
+	}
+
+	levels.resize(1);
+	levels[0].width = w;
+	levels[0].height = h;
+	levels[0].data.assign(pixels, pixels + (size_t)w*h*4);
+	stbi_image_free(pixels);
+
+	generateMipChain(levels);
+
+	// BC1 has only 1-bit alpha, so only opaque images are compressed
+	bool opaque = true;
+	const vector<unsigned char> &base = levels[0].data;
+	for(size_t i = 3; i < base.size() && opaque; i += 4) {
+		opaque = (base[i] == 255);
+	}
+
+	compressed = canCompress && opaque;
+	if(compressed) {
+		for(TextureLevel &level : levels) {
+			TextureLevel encoded;
+			encodeBC1(level, encoded);
+			level = move(encoded);
+		}
+		writeCache(cachePath, levels);
+	}
+	return true;
+}
+
+// Worker thread: decode queued textures until told to stop
+static void textureWorker(TextureStreamer *ts) {
+	while(true) {
+		int handle;
+		string path;
+		vector<unsigned char> embedded;
+		{
+			unique_lock<mutex> guard(ts->lock);
+			ts->wake.wait(guard, [ts] { return ts->stopping || !ts->pending.empty(); });
+			if(ts->stopping) return;
+			handle = ts->pending.front();
+			ts->pending.pop_front();
+			path = ts->textures[handle].path;
+			embedded = ts->textures[handle].embedded;
+		}
+
+		vector<TextureLevel> levels;
+		bool compressed = false;
+		bool ok = decodeTexture(ts->settings, ts->canCompress, path, embedded, levels, compressed);
+
+		{
+			lock_guard<mutex> guard(ts->lock);
+			StreamedTexture &tex = ts->textures[handle];
+			if(ok) {
+				tex.levels = move(levels);
+				tex.compressed = compressed;
+				tex.state = TEX_DECODED;
+				ts->decoded.push_back(handle);
+			}
+			else {
+				tex.state = TEX_FAILED;
+			}
+		}
+	}
+}
+
+// Start the worker threads and create the upload ring
+void startTextureStreamer(TextureStreamer &ts, TextureSettings settings) {
+	ts.settings = settings;
+
+	// BC1 needs S3TC support
+	ts.canCompress = settings.compress && GLEW_EXT_texture_compression_s3tc;
+	if(settings.compress && !ts.canCompress) {
+		cout << "S3TC not supported; textures will be uploaded uncompressed." << endl;
+	}
+
+	ts.pbos.resize(PBO_RING_SIZE);
+	for(UploadPBO &pbo : ts.pbos) {
+		glGenBuffers(1, &pbo.ID);
+	}
+
+	ts.stopping = false;
+	for(int i = 0; i < max(1, settings.workerCnt); i++) {
+		ts.workers.push_back(thread(textureWorker, &ts));
+	}
+}
+
+// Register a texture from a file; returns handle
+int addTextureFile(TextureStreamer &ts, string path) {
+	lock_guard<mutex> guard(ts.lock);
+	for(unsigned int i = 0; i < ts.textures.size(); i++) {
+		if(ts.textures[i].embedded.empty() && ts.textures[i].path == path) return (int)i;
+	}
+	StreamedTexture tex;
+	tex.path = path;
+	ts.textures.push_back(move(tex));
+	return (int)ts.textures.size() - 1;
+}
+
+// Register a texture from an embedded (still encoded) image; returns handle
+int addTextureMemory(TextureStreamer &ts, string name, const unsigned char *data, size_t size) {
+	lock_guard<mutex> guard(ts.lock);
+	StreamedTexture tex;
+	tex.path = name;
+	tex.embedded.assign(data, data + size);
+	ts.textures.push_back(move(tex));
+	return (int)ts.textures.size() - 1;
+}
+
+// Delete a resident texture's OpenGL object (it will be streamed again if used)
+static void evictTexture(TextureStreamer &ts, StreamedTexture &tex) {
+	glDeleteTextures(1, &tex.ID);
+	tex.ID = 0;
+	ts.residentBytes -= tex.gpuBytes;
+	ts.residentRGBABytes -= tex.rgbaBytes;
+	tex.gpuBytes = 0;
+	tex.rgbaBytes = 0;
+
+	lock_guard<mutex> guard(ts.lock);
+	tex.state = TEX_UNLOADED;
+}
+
+// Evict least recently used textures until needed bytes fit in the budget; false if they cannot fit yet
+static bool enforceBudget(TextureStreamer &ts, size_t neededBytes) {
+	while(ts.residentBytes + neededBytes > ts.settings.residencyBudget) {
+		// Never evict anything drawn last frame
+		StreamedTexture *victim = nullptr;
+		for(StreamedTexture &tex : ts.textures) {
+			if(tex.ID && tex.lastUsedFrame < ts.frame - 1 &&
+				(!victim || tex.lastUsedFrame < victim->lastUsedFrame)) {
+				victim = &tex;
+			}
+		}
+		if(!victim) return false;
+		evictTexture(ts, *victim);
+	}
+	return true;
+}
+
+// Copy a decoded mip chain into a PBO and create the immutable texture from it
+// Returns false if the next PBO is still in use by the GPU (try again next frame)
+static bool uploadTexture(TextureStreamer &ts, StreamedTexture &tex) {
+	UploadPBO &pbo = ts.pbos[ts.nextPBO];
+	if(pbo.fence) {
+		GLenum result = glClientWaitSync(pbo.fence, 0, 0);
+		if(result == GL_TIMEOUT_EXPIRED) return false;
+		glDeleteSync(pbo.fence);
+		pbo.fence = 0;
+	}
+
+	size_t total = 0;
+	for(TextureLevel &level : tex.levels) total += level.data.size();
+
+	// Fill PBO
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.ID);
+	if(pbo.size < total) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+		pbo.size = total;
+	}
+	unsigned char *dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if(!dst) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+	size_t offset = 0;
+	for(TextureLevel &level : tex.levels) {
+		memcpy(dst + offset, level.data.data(), level.data.size());
+		offset += level.data.size();
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// Create immutable texture and copy each level from the PBO
+	GLenum format = tex.compressed ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+	glGenTextures(1, &tex.ID);
+	glBindTexture(GL_TEXTURE_2D, tex.ID);
+	glTexStorage2D(GL_TEXTURE_2D, (GLsizei)tex.levels.size(), format, tex.levels[0].width, tex.levels[0].height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	offset = 0;
+	tex.rgbaBytes = 0;
+	for(unsigned int i = 0; i < tex.levels.size(); i++) {
+		TextureLevel &level = tex.levels[i];
+		if(tex.compressed) {
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height,
+				format, (GLsizei)level.data.size(), (void*)offset);
+		}
+		else {
+			glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height,
+				GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+		}
+		offset += level.data.size();
+		tex.rgbaBytes += levelSize(level.width, level.height, false);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// Remember when the GPU is done with this PBO
+	pbo.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ts.nextPBO = (ts.nextPBO + 1) % (int)ts.pbos.size();
+
+	// Track memory and release CPU copy
+	tex.gpuBytes = total;
+	ts.residentBytes += tex.gpuBytes;
+	ts.residentRGBABytes += tex.rgbaBytes;
+	lock_guard<mutex> guard(ts.lock);
+	tex.levels.clear();
+	tex.levels.shrink_to_fit();
+	tex.state = TEX_RESIDENT;
+	return true;
+}
+
+// Once per frame: upload finished decodes and enforce the residency budget
+void updateTextureStreamer(TextureStreamer &ts) {
+	ts.frame++;
+
+	for(int i = 0; i < ts.settings.uploadsPerFrame; i++) {
+		int handle;
+		{
+			lock_guard<mutex> guard(ts.lock);
+			if(ts.decoded.empty()) break;
+			handle = ts.decoded.front();
+		}
+
+		StreamedTexture &tex = ts.textures[handle];
+		size_t needed = 0;
+		for(TextureLevel &level : tex.levels) needed += level.data.size();
+
+		// Larger than the whole budget: it would never fit, so drop it instead of blocking the queue
+		if(needed > ts.settings.residencyBudget) {
+			cerr << "ERROR: Texture is larger than the residency budget: " << tex.path << endl;
+			tex.levels.clear();
+			tex.levels.shrink_to_fit();
+			lock_guard<mutex> guard(ts.lock);
+			tex.state = TEX_FAILED;
+			ts.decoded.pop_front();
+			continue;
+		}
+
+		// Everything resident was drawn last frame: keep it queued until something can be evicted
+		if(!enforceBudget(ts, needed)) break;
+		if(!uploadTexture(ts, tex)) break;
+
+		lock_guard<mutex> guard(ts.lock);
+		ts.decoded.pop_front();
+	}
+
+	enforceBudget(ts, 0);
+}
+
+// Get OpenGL texture for handle (0 if not resident yet); marks the texture as used this frame
+GLuint getTextureGL(TextureStreamer &ts, int handle) {
+	// addTextureFile/addTextureMemory can grow the vector at any time, so look the texture up under the lock
+	lock_guard<mutex> guard(ts.lock);
+	if(handle < 0 || handle >= (int)ts.textures.size()) return 0;
+
+	StreamedTexture &tex = ts.textures[handle];
+	tex.lastUsedFrame = ts.frame;
+	if(tex.ID) return tex.ID;
+
+	// Stream in on first use (or after eviction)
+	if(tex.state == TEX_UNLOADED) {
+		tex.state = TEX_QUEUED;
+		ts.pending.push_back(handle);
+		ts.wake.notify_one();
+	}
+	return 0;
+}
+
+// Print memory used by resident textures
+void printTextureStats(TextureStreamer &ts) {
+	int residentCnt = 0;
+	for(StreamedTexture &tex : ts.textures) {
+		if(tex.ID) residentCnt++;
+	}
+	cout << "Textures resident: " << residentCnt << " / " << ts.textures.size() << endl;
+	cout << "Texture memory: " << ts.residentBytes / 1024 << " KB";
+	cout << " (uncompressed would be " << ts.residentRGBABytes / 1024 << " KB)" << endl;
+}
+
+// Stop workers and delete all OpenGL objects
+void cleanupTextureStreamer(TextureStreamer &ts) {
+	{
+		lock_guard<mutex> guard(ts.lock);
+		ts.stopping = true;
+	}
+	ts.wake.notify_all();
+	for(thread &worker : ts.workers) {
+		worker.join();
+	}
+	ts.workers.clear();
+
+	for(StreamedTexture &tex : ts.textures) {
+		if(tex.ID) glDeleteTextures(1, &tex.ID);
+		tex.ID = 0;
+	}
+	ts.textures.clear();
+
+	for(UploadPBO &pbo : ts.pbos) {
+		if(pbo.fence) glDeleteSync(pbo.fence);
+		glDeleteBuffers(1, &pbo.ID);
+	}
+	ts.pbos.clear();
+	ts.residentBytes = 0;
+	ts.residentRGBABytes = 0;
+}
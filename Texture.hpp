@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+// Settings for the texture streamer
+struct TextureSettings {
+	// Number of worker threads decoding images
+	int workerCnt = 2;
+	// Encode opaque textures to BC1 (and cache the result on disk)?
+	bool compress = true;
+	// Where compressed mip chains are cached
+	std::string cacheDir = "./texcache";
+	// Maximum bytes of texture memory kept resident on the GPU
+	size_t residencyBudget = 256 * 1024 * 1024;
+	// Maximum number of textures uploaded per frame (keeps the render loop smooth)
+	int uploadsPerFrame = 2;
+};
+
+// One level of a mip chain (RGBA8 or BC1 blocks)
+struct TextureLevel {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> data;
+};
+
+// States a streamed texture moves through
+enum TextureState {
+	TEX_UNLOADED,
+	TEX_QUEUED,
+	TEX_DECODED,
+	TEX_RESIDENT,
+	TEX_FAILED
+};
+
+// Struct for holding one streamed texture
+struct StreamedTexture {
+	// Source: either a file path or a copy of an embedded image
+	std::string path;
+	std::vector<unsigned char> embedded;
+
+	TextureState state = TEX_UNLOADED;
+
+	// Decoded mip chain (only held between decode and upload)
+	bool compressed = false;
+	std::vector<TextureLevel> levels;
+
+	// OpenGL texture (once resident)
+	GLuint ID = 0;
+	size_t gpuBytes = 0;
+	size_t rgbaBytes = 0;
+	long long lastUsedFrame = -1;
+};
+
+// Pixel buffer used for uploads; fence tells us when the GPU is done reading it
+struct UploadPBO {
+	GLuint ID = 0;
+	size_t size = 0;
+	GLsync fence = 0;
+};
+
+// Struct for holding the texture streaming subsystem
+struct TextureStreamer {
+	TextureSettings settings;
+	bool canCompress = false;
+
+	// All textures (handles are indices into this vector)
+	std::vector<StreamedTexture> textures;
+
+	// Work shared with the decode threads
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<int> pending;
+	std::deque<int> decoded;
+	bool stopping = false;
+
+	// Upload ring
+	std::vector<UploadPBO> pbos;
+	int nextPBO = 0;
+
+	// Statistics
+	size_t residentBytes = 0;
+	size_t residentRGBABytes = 0;
+	long long frame = 0;
+};
+
+// Start the worker threads (needs a current OpenGL context for the upload ring)
+void startTextureStreamer(TextureStreamer &ts, TextureSettings settings);
+
+// Register a texture from a file; returns handle
+int addTextureFile(TextureStreamer &ts, std::string path);
+
+// Register a texture from an embedded (still encoded) image; returns handle
+int addTextureMemory(TextureStreamer &ts, std::string name, const unsigned char *data, size_t size);
+
+// Once per frame: upload finished decodes and enforce the residency budget
+void updateTextureStreamer(TextureStreamer &ts);
+
+// Get OpenGL texture for handle (0 if not resident yet); marks the texture as used this frame
+GLuint getTextureGL(TextureStreamer &ts, int handle);
+
+// Print memory used by resident textures
+void printTextureStats(TextureStreamer &ts);
+
+// Stop workers and delete all OpenGL objects
+void cleanupTextureStreamer(TextureStreamer &ts);
+
+// CPU helpers (also used by the workers)
+void generateMipChain(std::vector<TextureLevel> &levels);
+void encodeBC1(const TextureLevel &src, TextureLevel &dst);
@@ -0,0 +1,26 @@
+#define GLM_ENABLE_EXPERIMENTAL
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtx/transform.hpp"
+#include "Transform.hpp"
+using namespace std;
+
+//Generate Transformation to rotate around arbitrary point and axis:
+ glm::mat4 makeLocalRotate(glm::vec3 offset, glm::vec3 axis, float angle) {
+	 glm::mat4 translateNeg = glm::translate(-offset);
+	 glm::mat4 translatePos = glm::translate(offset);
+	 glm::mat4 rotate = glm::rotate(glm::radians(angle), glm::vec3(axis));
+	 glm::mat4 compositeTransformArb = translatePos * rotate * translateNeg;
+
+	 return compositeTransformArb;
+ }
+
+//Generate Transformation around local z axis
+glm::mat4 makeRotateZ(glm::vec3 offset, float angle) {
+	glm::mat4 translateNeg = glm::translate(-offset);
+	glm::mat4 translatePos = glm::translate(offset);
+	glm::mat4 rotate = glm::rotate(glm::radians(angle), glm::vec3(0, 0, 1));
+	glm::mat4 compositeTransformZ;
+	compositeTransformZ = translatePos * rotate * translateNeg;
+
+	return compositeTransformZ;
+}
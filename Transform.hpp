@@ -0,0 +1,9 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+// Generate Transformation to rotate around arbitrary point and axis (angle in degrees)
+glm::mat4 makeLocalRotate(glm::vec3 offset, glm::vec3 axis, float angle);
+
+// Generate Transformation around local z axis through offset (angle in degrees)
+glm::mat4 makeRotateZ(glm::vec3 offset, float angle);
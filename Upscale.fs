@@ -0,0 +1,37 @@
+#version 430 core
+
+layout(location=0) out vec4 out_color;
+
+in vec2 interUV;
+
+// Low resolution image (only part of it belongs to this window)
+uniform sampler2D sceneTex;
+// Start and size of that part (fractions of the texture)
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+// 0 = plain bilinear, 1 = strong sharpening
+uniform float sharpness;
+
+void main() {
+	vec2 texel = 1.0 / vec2(textureSize(sceneTex, 0));
+	vec2 uvMin = uvOffset + 0.5 * texel;
+	vec2 uvMax = uvOffset + uvScale - 0.5 * texel;
+	vec2 uv = clamp(uvOffset + interUV * uvScale, uvMin, uvMax);
+
+	// Bilinear upscale
+	vec3 center = texture(sceneTex, uv).rgb;
+
+	// Unsharp mask against the four neighbors (in source texels)
+	vec3 north = texture(sceneTex, min(uv + vec2(0.0, texel.y), uvMax)).rgb;
+	vec3 south = texture(sceneTex, max(uv - vec2(0.0, texel.y), uvMin)).rgb;
+	vec3 east = texture(sceneTex, min(uv + vec2(texel.x, 0.0), uvMax)).rgb;
+	vec3 west = texture(sceneTex, max(uv - vec2(texel.x, 0.0), uvMin)).rgb;
+	vec3 blur = 0.25 * (north + south + east + west);
+
+	// Clamp to neighborhood to avoid halos
+	vec3 lo = min(center, min(min(north, south), min(east, west)));
+	vec3 hi = max(center, max(max(north, south), max(east, west)));
+	vec3 sharpened = clamp(center + sharpness * (center - blur), lo, hi);
+
+	out_color = vec4(sharpened, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 430 core
+
+out vec2 interUV;
+
+void main()
+{
+	// Fullscreen triangle from the vertex ID (no vertex buffer needed)
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	interUV = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,388 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include "glm/glm.hpp"
+#include "Mesh.hpp"
+#include "Animation.hpp"
+#include "Transform.hpp"
+#include "BVH.hpp"
+using namespace std;
+
+// Settings from the command line
+struct BenchSettings {
+	// Each benchmark runs at least this long and this many times (after one warm-up run)
+	double minSeconds = 0.5;
+	int minIterations = 3;
+	// Largest synthetic mesh
+	long long maxTriangles = 10000000;
+	string jsonFile;
+	string baselineFile;
+	// Allowed slowdown against the baseline before it counts as a regression
+	double threshold = 0.10;
+	vector<string> fixtures;
+};
+
+// One measurement
+struct BenchResult {
+	string name;
+	// Work items per run (triangles, matrices, nodes...)
+	long long items = 0;
+	int iterations = 0;
+	double bestMs = 0.0;
+	double nsPerItem = 0.0;
+};
+
+// Keeps results alive so the compiler cannot drop the work
+volatile float benchSink = 0.0f;
+
+// Time fn until both minimums are met; the fastest run is reported
+template<typename F>
+void runBench(BenchSettings &bs, vector<BenchResult> &results, string name, long long items, F fn) {
+	fn();
+	double best = DBL_MAX;
+	double totalMs = 0.0;
+	int iterations = 0;
+	while(iterations < bs.minIterations || totalMs < bs.minSeconds * 1000.0) {
+		auto start = chrono::steady_clock::now();
+		fn();
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		best = min(best, ms);
+		totalMs += ms;
+		iterations++;
+	}
+
+	BenchResult r;
+	r.name = name;
+	r.items = items;
+	r.iterations = iterations;
+	r.bestMs = best;
+	r.nsPerItem = best * 1e6 / max(1LL, items);
+	results.push_back(r);
+	cout << name << ": " << r.bestMs << " ms (" << r.nsPerItem << " ns/item, " << iterations << " runs)" << endl;
+}
+
+// Grid of about triCnt triangles, laid out like a loaded mesh (positions, normals, UVs, faces)
+aiMesh *makeGridMesh(long long triCnt) {
+	int w = max(1, (int)sqrt(triCnt / 2.0));
+	int h = max(1, (int)(triCnt / (2LL * w)));
+
+	aiMesh *mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumVertices = (w + 1) * (h + 1);
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+	mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+	mesh->mNumUVComponents[0] = 2;
+	for(int y = 0; y <= h; y++) {
+		for(int x = 0; x <= w; x++) {
+			int i = y * (w + 1) + x;
+			mesh->mVertices[i] = aiVector3D((float)x / w, (float)y / h, 0.0f);
+			mesh->mNormals[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+			mesh->mTextureCoords[0][i] = aiVector3D((float)x / w, (float)y / h, 0.0f);
+		}
+	}
+
+	mesh->mNumFaces = 2 * w * h;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			unsigned int i = y * (w + 1) + x;
+			unsigned int quad[2][3] = { { i, i + 1, i + w + 1 }, { i + 1, i + w + 2, i + w + 1 } };
+			for(int t = 0; t < 2; t++) {
+				aiFace &face = mesh->mFaces[2 * (y * w + x) + t];
+				face.mNumIndices = 3;
+				face.mIndices = new unsigned int[3];
+				for(int k = 0; k < 3; k++) face.mIndices[k] = quad[t][k];
+			}
+		}
+	}
+	return mesh;
+}
+
+// Node tree of nodeCnt nodes, each with up to branching children (breadth first)
+aiNode *makeNodeTree(int nodeCnt, int branching) {
+	aiNode *root = new aiNode("node0");
+	vector<aiNode*> level = { root };
+	int created = 1;
+	while(created < nodeCnt && !level.empty()) {
+		vector<aiNode*> next;
+		for(aiNode *parent : level) {
+			int childCnt = min(branching, nodeCnt - created);
+			if(childCnt <= 0) break;
+			parent->mNumChildren = childCnt;
+			parent->mChildren = new aiNode*[childCnt];
+			for(int c = 0; c < childCnt; c++) {
+				aiNode *child = new aiNode("node" + to_string(created++));
+				child->mParent = parent;
+				child->mTransformation.a4 = 0.1f * c;
+				child->mTransformation.b4 = 0.2f;
+				parent->mChildren[c] = child;
+				next.push_back(child);
+			}
+		}
+		level.swap(next);
+	}
+	return root;
+}
+
+// ExtractMeshData on synthetic meshes from 1K triangles up to maxTriangles
+void benchExtractMeshData(BenchSettings &bs, vector<BenchResult> &results) {
+	for(long long triCnt = 1000; triCnt <= bs.maxTriangles; triCnt *= 10) {
+		aiMesh *mesh = makeGridMesh(triCnt);
+		Mesh m;
+		runBench(bs, results, "ExtractMeshData/" + to_string(triCnt), mesh->mNumFaces, [&]() {
+			ExtractMeshData(mesh, m);
+			benchSink = benchSink + m.vertices.back().position.x;
+		});
+		delete mesh;
+	}
+}
+
+// Picking one ray against synthetic meshes from 1K triangles up to maxTriangles (the target is under 1 ms at 10M)
+void benchPicking(BenchSettings &bs, vector<BenchResult> &results) {
+	const int rayCnt = 1024;
+	for(long long triCnt = 1000; triCnt <= bs.maxTriangles; triCnt *= 10) {
+		aiMesh *mesh = makeGridMesh(triCnt);
+		Mesh m;
+		ExtractMeshData(mesh, m);
+		delete mesh;
+
+		vector<MeshBVH> meshBVHs(1);
+		buildMeshBVH(m, meshBVHs[0]);
+		vector<PickInstance> instances(1);
+		instances[0].node = 0;
+		instances[0].sceneMesh = 0;
+		instances[0].meshBVH = 0;
+		SceneBVH sbvh;
+		buildSceneBVH(instances, meshBVHs, sbvh);
+
+		// Slanted rays spread over the grid (which covers 0..1 in x and y)
+		vector<glm::vec3> origins(rayCnt);
+		vector<glm::vec3> dirs(rayCnt);
+		for(int i = 0; i < rayCnt; i++) {
+			float u = (i % 32 + 0.5f) / 32.0f;
+			float v = (i / 32 + 0.5f) / 32.0f;
+			origins[i] = glm::vec3(u, v, 1.0f);
+			dirs[i] = glm::vec3(0.2f * (0.5f - u), 0.2f * (0.5f - v), -1.0f);
+		}
+
+		runBench(bs, results, "pickScene/" + to_string(triCnt), rayCnt, [&]() {
+			float sum = 0.0f;
+			for(int i = 0; i < rayCnt; i++) {
+				sum += pickScene(sbvh, meshBVHs, origins[i], dirs[i]).distance;
+			}
+			benchSink = benchSink + sum;
+		});
+	}
+}
+
+// Matrix conversion and the rotation helpers
+void benchTransforms(BenchSettings &bs, vector<BenchResult> &results) {
+	const int cnt = 4096;
+	vector<aiMatrix4x4> aiMats(cnt);
+	vector<glm::vec3> offsets(cnt);
+	vector<glm::vec3> axes(cnt);
+	for(int i = 0; i < cnt; i++) {
+		aiMats[i].a4 = (float)i;
+		aiMats[i].b1 = 0.5f * i;
+		offsets[i] = glm::vec3(0.01f * i, 0.02f * i, 0.03f * i);
+		axes[i] = glm::normalize(glm::vec3(1.0f, 0.001f * i, 0.5f));
+	}
+	glm::mat4 m;
+
+	runBench(bs, results, "aiMatToGLM4", cnt, [&]() {
+		float sum = 0.0f;
+		for(int i = 0; i < cnt; i++) {
+			aiMatToGLM4(aiMats[i], m);
+			sum += m[3][0];
+		}
+		benchSink = benchSink + sum;
+	});
+
+	runBench(bs, results, "makeLocalRotate", cnt, [&]() {
+		float sum = 0.0f;
+		for(int i = 0; i < cnt; i++) {
+			sum += makeLocalRotate(offsets[i], axes[i], 0.1f * i)[3][0];
+		}
+		benchSink = benchSink + sum;
+	});
+
+	runBench(bs, results, "makeRotateZ", cnt, [&]() {
+		float sum = 0.0f;
+		for(int i = 0; i < cnt; i++) {
+			sum += makeRotateZ(offsets[i], 0.1f * i)[3][0];
+		}
+		benchSink = benchSink + sum;
+	});
+}
+
+// Flattening the node tree (load) and updating global transforms (every frame)
+void benchSceneTraversal(BenchSettings &bs, vector<BenchResult> &results) {
+	int sizes[] = { 1000, 100000 };
+	for(int nodeCnt : sizes) {
+		aiNode *root = makeNodeTree(nodeCnt, 4);
+		FlatScene fs;
+		runBench(bs, results, "flattenScene/" + to_string(nodeCnt), nodeCnt, [&]() {
+			flattenScene(root, fs);
+			benchSink = benchSink + fs.nodes.back().globalMat[3][0];
+		});
+		runBench(bs, results, "updateGlobalTransforms/" + to_string(nodeCnt), nodeCnt, [&]() {
+			updateGlobalTransforms(fs);
+			benchSink = benchSink + fs.nodes.back().globalMat[3][0];
+		});
+		delete root;
+	}
+}
+
+// Loader paths on real models (same import flags as BasicGraphics)
+void benchFixtures(BenchSettings &bs, vector<BenchResult> &results) {
+	for(string &path : bs.fixtures) {
+		string name = filesystem::path(path).filename().string();
+		Assimp::Importer importer;
+		unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals
+			| aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights;
+		const aiScene *scene = importer.ReadFile(path, flags);
+		if(!scene || !scene->mRootNode) {
+			cerr << "Error loading fixture " << path << ": " << importer.GetErrorString() << endl;
+			continue;
+		}
+
+		long long triCnt = 0;
+		for(unsigned int i = 0; i < scene->mNumMeshes; i++) triCnt += scene->mMeshes[i]->mNumFaces;
+
+		runBench(bs, results, "Import/" + name, triCnt, [&]() {
+			Assimp::Importer loopImporter;
+			const aiScene *loopScene = loopImporter.ReadFile(path, flags);
+			benchSink = benchSink + (loopScene ? (float)loopScene->mNumMeshes : 0.0f);
+		});
+
+		vector<Mesh> meshes(scene->mNumMeshes);
+		runBench(bs, results, "ExtractMeshData/" + name, triCnt, [&]() {
+			for(unsigned int i = 0; i < scene->mNumMeshes; i++) {
+				ExtractMeshData(scene->mMeshes[i], meshes[i]);
+			}
+			benchSink = benchSink + (float)meshes[0].indices.size();
+		});
+
+		FlatScene fs;
+		runBench(bs, results, "flattenScene/" + name, 1, [&]() {
+			flattenScene(scene->mRootNode, fs);
+			benchSink = benchSink + (float)fs.nodes.size();
+		});
+	}
+}
+
+// Quote a string for JSON
+string jsonString(const string &s) {
+	string out = "\"";
+	for(char c : s) {
+		if(c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+// One benchmark per line, so baselines can be read back without a JSON library
+bool writeJSON(vector<BenchResult> &results, string filename) {
+	ofstream file(filename);
+	if(!file) return false;
+	file << "{" << endl << "\t\"benchmarks\": [" << endl;
+	for(unsigned int i = 0; i < results.size(); i++) {
+		BenchResult &r = results[i];
+		file << "\t\t{ \"name\": " << jsonString(r.name) << ", \"items\": " << r.items;
+		file << ", \"iterations\": " << r.iterations << ", \"best_ms\": " << r.bestMs;
+		file << ", \"ns_per_item\": " << r.nsPerItem << " }" << (i + 1 < results.size() ? "," : "") << endl;
+	}
+	file << "\t]" << endl << "}" << endl;
+	return true;
+}
+
+// Read name -> ns_per_item from a file written by writeJSON
+map<string, double> readBaseline(string filename) {
+	map<string, double> baseline;
+	ifstream file(filename);
+	string line;
+	while(getline(file, line)) {
+		size_t namePos = line.find("\"name\": \"");
+		size_t nsPos = line.find("\"ns_per_item\": ");
+		if(namePos == string::npos || nsPos == string::npos) continue;
+		namePos += 9;
+		string name;
+		for(size_t i = namePos; i < line.size() && line[i] != '"'; i++) {
+			if(line[i] == '\\' && i + 1 < line.size()) i++;
+			name += line[i];
+		}
+		baseline[name] = atof(line.c_str() + nsPos + 15);
+	}
+	return baseline;
+}
+
+// Print changes against the baseline; returns number of regressions
+int compareBaseline(vector<BenchResult> &results, map<string, double> &baseline, double threshold) {
+	int regressions = 0;
+	cout << endl << "Compared to baseline:" << endl;
+	for(BenchResult &r : results) {
+		auto found = baseline.find(r.name);
+		if(found == baseline.end() || found->second <= 0.0) {
+			cout << "\t" << r.name << ": new" << endl;
+			continue;
+		}
+		double change = r.nsPerItem / found->second - 1.0;
+		bool regressed = change > threshold;
+		if(regressed) regressions++;
+		cout << "\t" << r.name << ": " << found->second << " -> " << r.nsPerItem << " ns/item (";
+		cout << (change >= 0.0 ? "+" : "") << change * 100.0 << "%)" << (regressed ? " REGRESSION" : "") << endl;
+	}
+	return regressions;
+}
+
+int main(int argc, char **argv) {
+	//Options: [--json <out>] [--baseline <json>] [--threshold <fraction>] [--max-triangles <n>]
+	//         [--min-seconds <s>] [fixture models...]
+	BenchSettings bs;
+	for(int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if(arg == "--json" && i + 1 < argc) bs.jsonFile = argv[++i];
+		else if(arg == "--baseline" && i + 1 < argc) bs.baselineFile = argv[++i];
+		else if(arg == "--threshold" && i + 1 < argc) bs.threshold = atof(argv[++i]);
+		else if(arg == "--max-triangles" && i + 1 < argc) bs.maxTriangles = atoll(argv[++i]);
+		else if(arg == "--min-seconds" && i + 1 < argc) bs.minSeconds = atof(argv[++i]);
+		else bs.fixtures.push_back(arg);
+	}
+
+	vector<BenchResult> results;
+	benchExtractMeshData(bs, results);
+	benchPicking(bs, results);
+	benchTransforms(bs, results);
+	benchSceneTraversal(bs, results);
+	benchFixtures(bs, results);
+
+	if(!bs.jsonFile.empty()) {
+		if(!writeJSON(results, bs.jsonFile)) {
+			cerr << "Error: could not write " << bs.jsonFile << endl;
+			return 1;
+		}
+		cout << "Results written to " << bs.jsonFile << endl;
+	}
+
+	if(!bs.baselineFile.empty()) {
+		map<string, double> baseline = readBaseline(bs.baselineFile);
+		if(baseline.empty()) {
+			cerr << "Error: no results in baseline " << bs.baselineFile << endl;
+			return 1;
+		}
+		if(compareBaseline(results, baseline, bs.threshold) > 0) return 1;
+	}
+	return 0;
+}